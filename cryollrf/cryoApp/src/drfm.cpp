@@ -1,6 +1,8 @@
 
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <cmath>
 
 #include <errno.h>
 #include <string.h>
@@ -20,6 +22,13 @@
 #include <paramtable/scalar.h>
 #include <paramtable/table.h>
 #include <paramtable/group.h>
+#include <paramtable/trace.h>
+#include <paramtable/transaction.h>
+#include <paramtable/lockstats.h>
+#include <paramtable/shmexport.h>
+
+#include "ilc.h"
+#include "shape.h"
 
 #define PI (3.14159265359)
 
@@ -29,9 +38,145 @@ int cryoDebug = 1;
 
 namespace {
 
+inline double rampResolution(const UInt32&) {return 0.5;}
+inline double rampResolution(const Float64&) {return 1e-9;}
+
+inline void rampAssign(UInt32& p, double v) {p = epicsUInt32(std::max(0.0, v)+0.5);}
+inline void rampAssign(Float64& p, double v) {p = v;}
+
+//! Wrap a phase in degrees into (-180, 180].  Not finite becomes 0
+inline double wrapPhase(double v)
+{
+    v = std::fmod(v, 360.0);
+    if(v!=v)
+        return 0.0; // NaN or infinite
+    if(v>180.0)
+        v -= 360.0;
+    else if(v<=-180.0)
+        v += 360.0;
+    return v;
+}
+
+/** Move a setting towards a target value at a limited rate.
+ *
+ * Writing the target starts the ramp from the current value of the setting.
+ * Each call to step() advances according to the time elapsed since the previous step.
+ *
+ * Target and rate are in the raw units of the setting, and so take the same
+ * record conversion (ASLO/ESLO/LINR) as the setting.  Rate without EOFF.
+ *
+ * Profile 0 (linear) moves by 'rate' units per second.
+ * Profile 1 (exponential) approaches the target with a time constant
+ * chosen when the target is written, so that the initial rate is 'rate'.
+ * A rate of 0 jumps directly to the target.
+ *
+ * Any other write to the setting ends the ramp, which then does not
+ * overwrite it.
+ */
+template<typename T>
+class ramp {
+    value<T>& param;
+    double pos;
+    double span; // distance to the target when last written
+    epicsTime last;
+    T assigned;  // last value of the setting known to the ramp
+
+    void start()
+    {
+        if(!active) {
+            if(!param.isValid()) {
+                // nothing to ramp from
+                pos = target.get();
+            } else {
+                pos = param.get();
+            }
+        }
+        if(param.isValid())
+            assigned = param.get();
+        span = std::fabs(double(target.get())-pos);
+        last = epicsTime::getCurrent();
+        active = 1u;
+    }
+
+    // the setting changed.  Unless by step(), an operator write ends the ramp
+    void written()
+    {
+        T cur;
+        if(active && (!param.tryGet(cur) || cur!=assigned))
+            active = 0u;
+    }
+
+public:
+    value<T> target;
+    value<T> rate;
+    UInt32 profile;
+    UInt32 active;
+
+    template<typename C, typename FN>
+    ramp(C& t, value<T>& p, const std::string& n, FN fn)
+        :param(p)
+        ,pos(0.0)
+        ,span(0.0)
+        ,last()
+        ,assigned()
+        ,target(t, n+" Ramp Target", fn)
+        ,rate(t, n+" Ramp Rate")
+        ,profile(t, n+" Ramp Profile")
+        ,active(t, n+" Ramping")
+    {
+        target.connect(std::tr1::bind(&ramp::start, this))->setLabel("ramp start");
+        param.connect(std::tr1::bind(&ramp::written, this))->setLabel("ramp stop");
+        active = 0u;
+    }
+
+    //! Advance the ramp.  Returns true if the setting was changed.
+    bool step(const epicsTime& now)
+    {
+        if(!active)
+            return false;
+
+        double dt = now-last;
+        last = now;
+
+        T goalv, rv;
+        epicsUInt32 prof;
+        if(!target.tryGet(goalv) || !rate.tryGet(rv) || !profile.tryGet(prof)) {
+            active = 0u;
+            return false;
+        }
+        double goal = goalv, r = rv;
+
+        double delta = goal-pos;
+        if(r<=0.0 || span<=0.0) {
+            pos = goal;
+        } else if(prof==1) {
+            pos += delta*(1.0-std::exp(-r/span*dt));
+            if(std::fabs(goal-pos)<rampResolution(param))
+                pos = goal;
+        } else {
+            double lim = r*dt;
+            if(std::fabs(delta)<=lim)
+                pos = goal;
+            else
+                pos += delta>0.0 ? lim : -lim;
+        }
+
+        rampAssign(param, pos);
+        assigned = param.get();
+
+        if(pos==goal)
+            active = 0u;
+        return true;
+    }
+};
+
 class drfm : public table, public epicsThreadRunable {
 
+    // Before fromDevice and its members, which update it as they are destroyed
+    UInt32 device_sevr; // highest severity of fromDevice
     group fromDevice;
+    // Operator setpoints kept in the warm restart image.  See persistTo()
+    group settings;
 
     // Scalar settings
 
@@ -119,6 +264,41 @@ class drfm : public table, public epicsThreadRunable {
     Float64Vector ff_pha_rb;
     Float64Vector sp_amp_rb;
     Float64Vector sp_pha_rb;
+    // measured field
+    Float64Vector probe_amp;
+    Float64Vector probe_pha;
+
+    // Learning control
+
+    UInt32 ilc_enable;
+    Float64 ilc_amp_gain;
+    Float64 ilc_pha_gain;
+    UInt32 ilc_filter;
+
+    Float64 ilc_amp_err;
+    Float64 ilc_pha_err;
+    UInt32 ilc_count;
+
+    // Table shape generator
+
+    UInt32 gen_enable;
+    Float64 gen_delay;
+    Float64 gen_fill;
+    Float64 gen_flat;
+    Float64 gen_decay;
+    Float64 gen_sp_amp;
+    Float64 gen_sp_pha;
+    Float64 gen_ff_amp;
+    Float64 gen_ff_pha;
+    Float64 gen_pha_slope;
+
+    // Setpoint ramping
+
+    UInt32 ramp_mode;
+
+    ramp<epicsUInt32> ramp_gain_amp;
+    ramp<epicsUInt32> ramp_mo_high;
+    ramp<epicsFloat64> ramp_gen_sp_amp;
 
     // Software
 
@@ -131,6 +311,19 @@ class drfm : public table, public epicsThreadRunable {
     UInt32 rxcount;
     UInt32 txcount;
 
+    // Link statistics, published by the stats timer
+
+    Float64 tx_rate;
+    Float64 rx_rate;
+    Float64 tx_msg_rate;
+    Float64 rx_msg_rate;
+    UInt32 tx_queue;
+    UInt32 tx_queue_max;
+    UInt32 rx_queue;
+    UInt32 tx_deferred;
+    UInt32 reconnects;
+    Float64 downtime;
+
     Float64Vector timebase;
 
     String message;
@@ -139,6 +332,9 @@ class drfm : public table, public epicsThreadRunable {
 
     UInt32 commit;
 
+    // NULL unless persistTo()
+    std::auto_ptr<shmExporter> persistent;
+
     epicsTime startUpdate, endUpdate;
 
     std::string host;
@@ -154,11 +350,34 @@ class drfm : public table, public epicsThreadRunable {
     struct event_base *reactor;
     struct event *reconnect_timo;
     bool reconnect_scheduled;
+    struct event *ramp_timo;
+    bool ramp_scheduled;
+    struct event *stats_timo;
     struct evdns_base *resolver;
     struct bufferevent *session;
 
     bool scalarready;
     bool tableready;
+    bool pulseready;
+    bool probeready;
+    bool shapeready;
+
+    std::vector<double> ilc_err, ilc_filt, ilc_sum;
+    std::vector<double> gen_env;
+
+    /* Link counters accumulated on the reactor thread.
+     * Plain integers, only copied to parameters by stats()
+     */
+    struct linkcounts {
+        size_t txbytes, rxbytes, txmsgs, rxmsgs, txdeferred;
+        linkcounts() :txbytes(0), rxbytes(0), txmsgs(0), rxmsgs(0), txdeferred(0) {}
+    } link, linkprev;
+    size_t obuf_peak;
+    bool was_connected;
+    epicsTime statsLast, downSince;
+    double downPrev;
+
+    void countsent(size_t bytes);
 
     void changeConnect();
 
@@ -171,8 +390,22 @@ class drfm : public table, public epicsThreadRunable {
     void recvscalar(const epicsUInt32*, size_t);
     void recvff(const epicsUInt32*, size_t);
     void recvsp(const epicsUInt32*, size_t);
+    void recvprobe(const epicsUInt32*, size_t);
     void senddata();
 
+    void flush();
+
+    void startRamp();
+    bool stepRamps();
+
+    void genshape();
+    void genamp(Float64Vector& wf, double amp);
+    void genpha(Float64Vector& wf, double t0, double offset, double slope);
+
+    bool learn();
+    bool learn(Float64Vector& ff, const Float64Vector& sp, const Float64Vector& meas,
+               Float64& rms, bool phase, double gain, size_t width);
+
     virtual void run();
 
     template<bool (drfm::*V)>
@@ -188,10 +421,15 @@ class drfm : public table, public epicsThreadRunable {
 public:
     drfm(const char*, const char*, unsigned short, const char*);
 
+    void persistTo(const std::string& shmname);
+
     // Callbacks for libevent
     // run from C code
     void eventcb(short evt);
     void recvdata();
+    void endpulse();
+    void tick();
+    void stats();
     void stop();
     void start_connection();
 };
@@ -200,7 +438,7 @@ extern "C" void drfm_event_cb(bufferevent*, short evts, void *priv)
 {
     drfm *ctrl=(drfm*)priv;
     try {
-        Guard g(ctrl->mutex());
+        tableGuard g(*ctrl, lockSiteReactor);
         ctrl->eventcb(evts);
         ctrl->dispatch();
     }catch(std::exception& e){
@@ -213,15 +451,42 @@ extern "C" void drfm_data_cb(bufferevent*, void *priv)
 {
     drfm *ctrl=(drfm*)priv;
     try {
-        Guard g(ctrl->mutex());
+        tableGuard g(*ctrl, lockSiteReactor);
         ctrl->recvdata();
         ctrl->dispatch();
+        ctrl->endpulse();
     }catch(std::exception& e){
         errlogPrintf("%s: Exception in drfm_data_cb: %s\n",
                      ctrl->name().c_str(), e.what());
     }
 }
 
+extern "C" void drfm_ramp_tick(int,short,void* priv)
+{
+    drfm *ctrl=(drfm*)priv;
+    try {
+        tableGuard g(*ctrl, lockSiteReactor);
+        ctrl->tick();
+        ctrl->dispatch();
+    }catch(std::exception& e){
+        errlogPrintf("%s: Exception in drfm_ramp_tick: %s\n",
+                     ctrl->name().c_str(), e.what());
+    }
+}
+
+extern "C" void drfm_stats_tick(int,short,void* priv)
+{
+    drfm *ctrl=(drfm*)priv;
+    try {
+        tableGuard g(*ctrl, lockSiteReactor);
+        ctrl->stats();
+        ctrl->dispatch();
+    }catch(std::exception& e){
+        errlogPrintf("%s: Exception in drfm_stats_tick: %s\n",
+                     ctrl->name().c_str(), e.what());
+    }
+}
+
 extern "C" void drfm_shutdown(void* priv)
 {
     drfm *ctrl=(drfm*)priv;
@@ -237,7 +502,7 @@ extern "C" void drfm_reconnect(int,short,void* priv)
 {
     drfm *ctrl=(drfm*)priv;
     try {
-        Guard g(ctrl->mutex());
+        tableGuard g(*ctrl, lockSiteReactor);
         ctrl->start_connection();
         ctrl->dispatch();
     }catch(std::exception& e){
@@ -249,7 +514,9 @@ extern "C" void drfm_reconnect(int,short,void* priv)
 drfm::drfm(const char *name, const char* host, unsigned short port, const char* type)
     :table(name)
     ,epicsThreadRunable()
+    ,device_sevr(*this,"Device Severity")
     ,fromDevice(*this)
+    ,settings(*this)
     ,reset(*this,"Reset", &drfm::action<&drfm::cmd_reset>)
     ,cmd_reset(false)
     ,trigedge(*this,"Trig Edge", &drfm::markReady<&drfm::scalarready>)
@@ -333,6 +600,39 @@ drfm::drfm(const char *name, const char* host, unsigned short port, const char*
     ,ff_pha_rb(fromDevice,"FF Phase RB")
     ,sp_amp_rb(fromDevice,"SP Amp RB")
     ,sp_pha_rb(fromDevice,"SP Phase RB")
+    ,probe_amp(fromDevice,"Probe Amp")
+    ,probe_pha(fromDevice,"Probe Phase")
+
+// Learning control
+
+    ,ilc_enable(*this,"ILC Enable")
+    ,ilc_amp_gain(*this,"ILC Amp Gain")
+    ,ilc_pha_gain(*this,"ILC Phase Gain")
+    ,ilc_filter(*this,"ILC Filter")
+
+    ,ilc_amp_err(fromDevice,"ILC Amp Error")
+    ,ilc_pha_err(fromDevice,"ILC Phase Error")
+    ,ilc_count(*this,"ILC Count")
+
+// Table shape generator
+
+    ,gen_enable(*this,"Gen Enable", &drfm::markReady<&drfm::shapeready>)
+    ,gen_delay(*this,"Gen Delay", &drfm::markReady<&drfm::shapeready>)
+    ,gen_fill(*this,"Gen Fill Time", &drfm::markReady<&drfm::shapeready>)
+    ,gen_flat(*this,"Gen Flat Time", &drfm::markReady<&drfm::shapeready>)
+    ,gen_decay(*this,"Gen Decay Time", &drfm::markReady<&drfm::shapeready>)
+    ,gen_sp_amp(*this,"Gen SP Amp", &drfm::markReady<&drfm::shapeready>)
+    ,gen_sp_pha(*this,"Gen SP Phase", &drfm::markReady<&drfm::shapeready>)
+    ,gen_ff_amp(*this,"Gen FF Amp", &drfm::markReady<&drfm::shapeready>)
+    ,gen_ff_pha(*this,"Gen FF Phase", &drfm::markReady<&drfm::shapeready>)
+    ,gen_pha_slope(*this,"Gen Phase Slope", &drfm::markReady<&drfm::shapeready>)
+
+// Setpoint ramping
+
+    ,ramp_mode(*this,"Ramp Mode", &drfm::startRamp)
+    ,ramp_gain_amp(*this, gain_amp, "Gain Amp", &drfm::startRamp)
+    ,ramp_mo_high(*this, mo_high, "MO Amp High", &drfm::startRamp)
+    ,ramp_gen_sp_amp(*this, gen_sp_amp, "Gen SP Amp", &drfm::startRamp)
 
 // Software
     ,model(*this,"Model")
@@ -341,11 +641,22 @@ drfm::drfm(const char *name, const char* host, unsigned short port, const char*
     ,connected(*this,"Connected")
     ,rxcount(*this,"RX Count")
     ,txcount(*this,"TX Count")
+    ,tx_rate(*this,"TX Rate")
+    ,rx_rate(*this,"RX Rate")
+    ,tx_msg_rate(*this,"TX Msg Rate")
+    ,rx_msg_rate(*this,"RX Msg Rate")
+    ,tx_queue(*this,"TX Queue")
+    ,tx_queue_max(*this,"TX Queue Max")
+    ,rx_queue(*this,"RX Queue")
+    ,tx_deferred(*this,"TX Deferred")
+    ,reconnects(*this,"Reconnects")
+    ,downtime(*this,"Down Time")
     ,timebase(*this,"Time")
     ,message(*this,"Message")
 
 // Internal
     ,commit(*this,"Commit", &drfm::senddata)
+    ,persistent()
     ,startUpdate()
     ,endUpdate()
     ,host(host)
@@ -355,9 +666,22 @@ drfm::drfm(const char *name, const char* host, unsigned short port, const char*
     ,runner(*this, "drfm", epicsThreadGetStackSize(epicsThreadStackSmall), epicsThreadPriorityHigh)
     ,scratch(4001)
     ,reconnect_scheduled(false)
+    ,ramp_scheduled(false)
     ,session(0)
     ,scalarready(false)
     ,tableready(false)
+    ,pulseready(false)
+    ,probeready(false)
+    ,shapeready(false)
+    ,ilc_err(1000)
+    ,ilc_filt(1000)
+    ,ilc_sum(1001)
+    ,gen_env(1000)
+    ,obuf_peak(0)
+    ,was_connected(false)
+    ,statsLast(epicsTime::getCurrent())
+    ,downSince(statsLast)
+    ,downPrev(0.0)
 {
     std::string stype(type);
 
@@ -371,6 +695,10 @@ drfm::drfm(const char *name, const char* host, unsigned short port, const char*
     model.setWritable(false);
     settime();
 
+    // cryoDebug selects the initial trace level.  See tblTrace
+    // Dispatch tracing is per pulse and per put, so only on request
+    setTrace(cryoDebug ? unsigned(traceAll)&~unsigned(traceDispatch) : 0u, cryoDebug);
+
     if(cryoDebug)
         printf("Connecting to %s:%u\n", this->host.c_str(), this->port);
 
@@ -378,6 +706,56 @@ drfm::drfm(const char *name, const char* host, unsigned short port, const char*
     connected = 0u;
     rxcount = 0u;
     txcount = 0u;
+    ilc_enable = 0u;
+    ilc_count = 0u;
+    gen_enable = 0u;
+    ramp_mode = 0u;
+    tx_rate = 0.0;
+    rx_rate = 0.0;
+    tx_msg_rate = 0.0;
+    rx_msg_rate = 0.0;
+    tx_queue = 0u;
+    tx_queue_max = 0u;
+    rx_queue = 0u;
+    tx_deferred = 0u;
+    reconnects = 0u;
+    downtime = 0.0;
+    fromDevice.publishSummary(&device_sevr);
+
+    // Not commands, ILC or shape generator enables, or ramp targets
+    settings<<trigedge<<affctrl
+            <<gain_amp<<gain_pha<<bwidth_amp<<bwidth_pha
+            <<trig_delay<<time_run<<mo_high<<mo_low
+            <<temp_warn<<temp_err<<stab_amp_h<<stab_amp_l
+            <<probe_cal_pha<<dac_off_i<<dac_off_q
+            <<stab_pha_h<<stab_pha_l<<aff_corr_lim<<fill_time
+            <<stab_evnt_dly<<stab_evnt_max<<amp_thres<<loop_delay
+            <<ff_amp<<ff_pha<<sp_amp<<sp_pha
+            <<ilc_amp_gain<<ilc_pha_gain<<ilc_filter
+            <<gen_delay<<gen_fill<<gen_flat<<gen_decay
+            <<gen_sp_amp<<gen_sp_pha<<gen_ff_amp<<gen_ff_pha<<gen_pha_slope;
+
+    // Noisy readbacks.  Suppress changes below half of the displayed
+    // step (PREC), so a suppressed change leaves the display at most one
+    // least significant digit behind.
+    // Not temp.  One count (0.0625 C) is more than half a step (0.05 C).
+    mo_amp.setDeadband(1.0);         // raw, ~0.00035 dBm (PREC 3)
+    fw_loop_time.setDeadband(0.004); // ms (PREC 2)
+
+    // Table echoes are identical on most pulses.  Only notify when they differ
+    ff_amp_rb.setNotifyOnChange(true);
+    ff_pha_rb.setNotifyOnChange(true);
+    sp_amp_rb.setNotifyOnChange(true);
+    sp_pha_rb.setNotifyOnChange(true);
+
+    // Display-only readbacks.  No need to follow every pulse
+    ff_amp_rb.setMaxRate(10.0);
+    ff_pha_rb.setMaxRate(10.0);
+    sp_amp_rb.setMaxRate(10.0);
+    sp_pha_rb.setMaxRate(10.0);
+    probe_amp.setMaxRate(10.0);
+    probe_pha.setMaxRate(10.0);
+    fw_loop_time.setMaxRate(10.0);
 
     commit.setNotifyOnChange(false);
     reset.setNotifyOnChange(false);
@@ -403,6 +781,18 @@ drfm::drfm(const char *name, const char* host, unsigned short port, const char*
     if(!reconnect_timo)
         throw std::bad_alloc();
 
+    ramp_timo = event_new(reactor, -1, EV_PERSIST, &drfm_ramp_tick, (void*)this);
+    if(!ramp_timo)
+        throw std::bad_alloc();
+
+    stats_timo = event_new(reactor, -1, EV_PERSIST, &drfm_stats_tick, (void*)this);
+    if(!stats_timo)
+        throw std::bad_alloc();
+    {
+        static const timeval period = {1, 0};
+        event_add(stats_timo, &period);
+    }
+
     resolver = evdns_base_new(reactor, 1);
     if(!resolver)
         throw std::bad_alloc();
@@ -417,15 +807,13 @@ void drfm::start_connection()
 
     close_connection();
 
-    if(cryoDebug)
-        errlogPrintf("%s: Connect %s:%u\n", name().c_str(), host.c_str(), port);
+    TBL_TRACE(*this, traceConnection, 1, "Connect %s:%u", host.c_str(), (unsigned)port);
 
     session = bufferevent_socket_new(reactor, -1,
                                      BEV_OPT_CLOSE_ON_FREE|BEV_OPT_THREADSAFE|
                                      BEV_OPT_DEFER_CALLBACKS|BEV_OPT_UNLOCK_CALLBACKS);
 
-    if(cryoDebug)
-        errlogPrintf(" session=%8x\n", (unsigned long)session);
+    TBL_TRACE(*this, traceConnection, 2, " session=%p", (const void*)session);
 
     if(!session) {
         throw std::bad_alloc();
@@ -455,9 +843,10 @@ void drfm::close_connection()
         session=0;
         next_header=0;
         expect=4;
-        if(cryoDebug)
-            errlogPrintf("%s: Disconnect\n", name().c_str());
+        TBL_TRACE(*this, traceConnection, 1, "Disconnect");
         message = "Disconnect";
+        if(connected)
+            downSince = epicsTime::getCurrent();
         connected=0u;
         fromDevice.setValid(false);
     }
@@ -466,8 +855,8 @@ void drfm::close_connection()
 void drfm::changeConnect()
 {
 
-    if(cryoDebug)
-      errlogPrintf("changeConnect: connected=%d tryConnect=%d reconnect=%d\n", (int)connected, (int)tryConnect, (int)reconnect_scheduled );
+    TBL_TRACE(*this, traceConnection, 1, "changeConnect: connected=%d tryConnect=%d reconnect=%d",
+              connected.get(), tryConnect.get(), (int)reconnect_scheduled);
 
     if(!connected && !tryConnect && reconnect_scheduled) {
         evtimer_del(reconnect_timo);
@@ -494,11 +883,7 @@ void drfm::sendscalar()
     if(!connected)
         return;
     try {
-        if(cryoDebug) {
-          errlogPrintf(" - sendscalar(): Trying...");
-          if(cmd_reset) errlogPrintf("- RESET -");
-          errlogPrintf("\n");
-          }
+        TBL_TRACE(*this, traceSend, 2, " - sendscalar(): Trying...%s", cmd_reset ? "- RESET -" : "");
         scratch[0]=htonl(0x10010000);
 
         epicsUInt32 bits=0;
@@ -550,40 +935,33 @@ void drfm::sendscalar()
         scratch[30]=0;
         scratch[31]=0;
 
-        if(cryoDebug)
-          errlogPrintf(" - sendscalar(): Values set, RESET_CMD=%08x\n", bits);
+        TBL_TRACE(*this, traceSend, 2, " - sendscalar(): Values set, RESET_CMD=%08x", bits);
 
     }catch(invalid_value_error& e){
         // don't send unless all inputs are valid
         message=std::string("Scalar set ")+e.what();
-        if(cryoDebug)
-          errlogPrintf("sendscalar(): Scalar set:%s\n", e.what() );
+        TBL_TRACE(*this, traceSend, 1, "sendscalar(): Scalar set invalid");
         return;
     }
 
     evbuffer *obuf=bufferevent_get_output(session);
-    if(cryoDebug)
-      errlogPrintf(" - sendscalar(): buflen=%d\n", evbuffer_get_length(obuf) );
+    TBL_TRACE(*this, traceSend, 2, " - sendscalar(): buflen=%u", (unsigned long)evbuffer_get_length(obuf));
 
     if(evbuffer_get_length(obuf)>2*4001*4) {
         scalarready=true;
+        link.txdeferred++;
         return;
     }
 
-    if(cryoDebug) {
-      errlogPrintf(" - sendscalar(): AFF_IN_D    = %08x\n", htonl(scratch[0]));
-      errlogPrintf(" - sendscalar(): PCK_LEN_W   = %d\n",   htonl(scratch[1]));
-      errlogPrintf(" - sendscalar(): RESET_CM    = %08x\n", htonl(scratch[2]));
-      errlogPrintf(" - sendscalar(): GAIN_AMP_SP = %08x\n", htonl(scratch[3]));
-      errlogPrintf(" - sendscalar(): GAIN_PH_SP  = %08x\n", htonl(scratch[4]));
-      }
+    TBL_TRACE(*this, traceSend, 2, " - sendscalar(): AFF_IN_D=%08x RESET_CM=%08x GAIN_AMP_SP=%08x GAIN_PH_SP=%08x",
+              ntohl(scratch[0]), ntohl(scratch[1]), ntohl(scratch[2]), ntohl(scratch[3]));
 
     if(bufferevent_write(session, &scratch[0], (model ? 32 : 28 )*4)!=0)
         throw std::runtime_error("Error sending scalar message");
     txcount = txcount + 1;
+    countsent((model ? 32 : 28 )*4);
 
-    if(cryoDebug)
-      errlogPrintf(" - sendscalar(): %d sent-\n", (int)txcount);
+    TBL_TRACE(*this, traceSend, 1, " - sendscalar(): %u sent", txcount.get());
 
 }
 
@@ -606,7 +984,7 @@ void drfm::sendtable()
             const Float64Vector::value_type& wf=ff_pha;
             for(size_t i=0; i<1000; i++) {
                 double v = i<wf.size() ? wf[i] : 0.0;
-                v = std::max(-180.0, std::min(v, 180.0))/180.0;
+                v = wrapPhase(v)/180.0;
                 epicsInt32 tmp=epicsInt32(v*double(0x1ffff));
                 scratch[i + 1001] = htonl(tmp);
             }
@@ -624,7 +1002,7 @@ void drfm::sendtable()
             const Float64Vector::value_type& wf=sp_pha;
             for(size_t i=0; i<1000; i++) {
                 double v = i<wf.size() ? wf[i] : 0.0;
-                v = std::max(-180.0, std::min(v, 180.0))/180.0;
+                v = wrapPhase(v)/180.0;
                 epicsInt32 tmp=epicsInt32(v*double(0x1ffff));
                 scratch[i + 3001] = htonl(tmp);
             }
@@ -639,15 +1017,32 @@ void drfm::sendtable()
     evbuffer *obuf=bufferevent_get_output(session);
     if(evbuffer_get_length(obuf)>2*4001*4) {
         tableready=true;
+        link.txdeferred++;
         return;
     }
 
     if(bufferevent_write(session, &scratch[0], 4001*4)!=0)
         throw std::runtime_error("Error sending scalar message");
     txcount = txcount + 1;
+    countsent(4001*4);
+
+    TBL_TRACE(*this, traceSend, 1, " - sendtable(): %u sent", txcount.get());
 
 }
 
+/* Account for a message just queued for sending.
+ * The output buffer depth is sampled here as it only grows on send.
+ */
+void drfm::countsent(size_t bytes)
+{
+    link.txmsgs++;
+    link.txbytes += bytes;
+
+    size_t depth = evbuffer_get_length(bufferevent_get_output(session));
+    if(depth>obuf_peak)
+        obuf_peak = depth;
+}
+
 void drfm::settime()
 {
     //EGU: us
@@ -673,24 +1068,30 @@ void drfm::recvscalar(const epicsUInt32 *data, size_t size)
 
     startUpdate = epicsTime::getCurrent();
 
-    comm_count = ntohl(data[0]);
+    // all readbacks of one message share a time stamp
+    transaction T(*this);
+    T.setTimestamp(startUpdate);
+
+    T.set(comm_count, ntohl(data[0]));
 
     epicsUInt32 bits = ntohl(data[1]);
 
-    err_sum       = (bits>>0)&1;
-    ilock         = (bits>>1)&1;
-    stab_amp_sts  = (bits>>2)&1;
-    stab_pha_sts  = (bits>>3)&1;
-    mo_sts        = (bits>>4)&1;
-    mo_clk_sts    = (bits>>5)&1;
-    temp_err_sts  = (bits>>6)&1;
-    temp_warn_sts = (bits>>7)&1;
-    affctrl_sts   = (bits>>8)&1;
+    T.set(err_sum,       (bits>>0)&1);
+    T.set(ilock,         (bits>>1)&1);
+    T.set(stab_amp_sts,  (bits>>2)&1);
+    T.set(stab_pha_sts,  (bits>>3)&1);
+    T.set(mo_sts,        (bits>>4)&1);
+    T.set(mo_clk_sts,    (bits>>5)&1);
+    T.set(temp_err_sts,  (bits>>6)&1);
+    T.set(temp_warn_sts, (bits>>7)&1);
+    T.set(affctrl_sts,   (bits>>8)&1);
+
+    T.set(mo_amp, ntohl(data[2]));
+    T.set(mo_pha, ntohl(data[3]));
 
-    mo_amp = ntohl(data[2]);
-    mo_pha = ntohl(data[3]);
+    T.set(temp, ntohl(data[4]));
 
-    temp = ntohl(data[4]);
+    T.commit();
 
     //fw_loop_time = ntohl(data[5]);
 }
@@ -707,7 +1108,7 @@ void drfm::recvff(const epicsUInt32 *data, size_t size)
             wf[i] = ntohl(data[i])/double(0x1ffff);
         }
         ff_amp_rb.setValid(true);
-        ff_amp_rb.markChanged();
+        ff_amp_rb.markModified();
     }
     {
         Float64Vector::value_type& wf=ff_pha_rb.get();
@@ -716,7 +1117,7 @@ void drfm::recvff(const epicsUInt32 *data, size_t size)
             wf[i] = epicsInt32(ntohl(data[1000 + i]))/double(0x1ffff)*180.0;
         }
         ff_pha_rb.setValid(true);
-        ff_pha_rb.markChanged();
+        ff_pha_rb.markModified();
     }
 }
 
@@ -732,7 +1133,7 @@ void drfm::recvsp(const epicsUInt32 *data, size_t size)
             wf[i] = ntohl(data[i])/double(0x1ffff);
         }
         sp_amp_rb.setValid(true);
-        sp_amp_rb.markChanged();
+        sp_amp_rb.markModified();
     }
     {
         Float64Vector::value_type& wf=sp_pha_rb.get();
@@ -741,7 +1142,7 @@ void drfm::recvsp(const epicsUInt32 *data, size_t size)
             wf[i] = epicsInt32(ntohl(data[1000 + i]))/double(0x1ffff)*180.0;
         }
         sp_pha_rb.setValid(true);
-        sp_pha_rb.markChanged();
+        sp_pha_rb.markModified();
     }
 
     epicsTime now(epicsTime::getCurrent());
@@ -750,17 +1151,52 @@ void drfm::recvsp(const epicsUInt32 *data, size_t size)
     updatePeriod=(now-endUpdate)*1000.0;
 
     endUpdate=now;
+
+    pulseready=true;
+}
+
+/* Measured field (probe) waveforms.  Same layout as the SP echo
+ */
+void drfm::recvprobe(const epicsUInt32 *data, size_t size)
+{
+    if(size<2000)
+        throw std::logic_error("probe packet too small");
+
+    {
+        Float64Vector::value_type& wf=probe_amp.get();
+        wf.resize(1000);
+        for(size_t i=0; i<1000; i++) {
+            wf[i] = ntohl(data[i])/double(0x1ffff);
+        }
+        probe_amp.setValid(true);
+        probe_amp.markModified();
+    }
+    {
+        Float64Vector::value_type& wf=probe_pha.get();
+        wf.resize(1000);
+        for(size_t i=0; i<1000; i++) {
+            wf[i] = epicsInt32(ntohl(data[1000 + i]))/double(0x1ffff)*180.0;
+        }
+        probe_pha.setValid(true);
+        probe_pha.markModified();
+    }
+
+    probeready=true;
 }
 
 void drfm::eventcb(short evt)
 {
-    if(cryoDebug)
-        errlogPrintf("eventcb(%x)\n", evt);
+    TBL_TRACE(*this, traceConnection, 2, "eventcb(%x)", (int)evt);
     if(evt&BEV_EVENT_CONNECTED) {
         connected = 1u;
         message = "Connected";
-        if(cryoDebug)
-            errlogPrintf("%s: Connected\n", name().c_str());
+
+        if(was_connected)
+            reconnects = reconnects + 1;
+        else
+            was_connected = true;
+        downPrev += epicsTime::getCurrent()-downSince;
+        TBL_TRACE(*this, traceConnection, 1, "Connected");
 
         changeConnect();
         if(!connected) {
@@ -774,24 +1210,27 @@ void drfm::eventcb(short evt)
         // Device might have rebooted
         sendscalar();
         sendtable();
-        if(cryoDebug)
-            errlogPrintf("%s: Resynced\n", name().c_str());
+        TBL_TRACE(*this, traceConnection, 1, "Resynced");
 
     } else if(evt&(BEV_EVENT_ERROR|BEV_EVENT_EOF|BEV_EVENT_TIMEOUT)) {
 
         std::string msg;
         if(evt&BEV_EVENT_ERROR) {
+            int err = EVUTIL_SOCKET_ERROR();
             msg = "Socket Error: ";
-            msg+=evutil_socket_error_to_string(EVUTIL_SOCKET_ERROR());
+            msg+=evutil_socket_error_to_string(err);
+            TBL_TRACE(*this, traceConnection, 1, "Socket Error %d", err);
         }else if(evt&BEV_EVENT_TIMEOUT) {
             msg = "Rx Timeout";
+            TBL_TRACE(*this, traceConnection, 1, "Rx Timeout");
             close_connection();
-        } else
+        } else {
             msg = "Connection Closed";
+            TBL_TRACE(*this, traceConnection, 1, "Connection Closed");
+        }
 
-        if(cryoDebug)
-            errlogPrintf("%s: %s\n", name().c_str(), msg.c_str());
-
+        if(connected)
+            downSince = epicsTime::getCurrent();
         connected = 0u;
         if(tryConnect && !reconnect_scheduled) {
             timeval timo = {3,0};
@@ -825,6 +1264,8 @@ void drfm::recvdata()
             return;
         }
 
+        TBL_TRACE(*this, traceReceive, 2, "recvdata(): header %08x", next_header);
+
         switch(next_header) {
         case 0x20010000: expect=2000*4; break;
         case 0x20020000: expect=2000*4; break;
@@ -842,6 +1283,8 @@ void drfm::recvdata()
         epicsUInt32 *raw=(epicsUInt32*)evbuffer_pullup(buf, expect);
 
         rxcount = rxcount + 1;
+        link.rxmsgs++;
+        link.rxbytes += 4+expect;
 
         try {
 
@@ -849,7 +1292,7 @@ void drfm::recvdata()
             case 0x20010000: recvscalar(raw, expect); break;
             case 0x20020000: recvff(raw, expect); break;
             case 0x20030000: recvsp(raw, expect); break;
-            case 0x20040000: break;
+            case 0x20040000: recvprobe(raw, expect); break;
             }
         }catch(...){
             evbuffer_drain(buf, expect);
@@ -868,8 +1311,69 @@ void drfm::recvdata()
     bufferevent_setwatermark(session, EV_READ, expect, 0);
 }
 
+/* Compute the SP and FF tables from the shape parameters.
+ * Only called when a shape parameter has changed.
+ */
+void drfm::genshape()
+{
+    shape::params P;
+    double spamp, sppha, ffamp, ffpha, slope;
+    try {
+        if(!gen_enable)
+            return;
+        P.delay = gen_delay;
+        P.fill  = gen_fill;
+        P.flat  = gen_flat;
+        P.decay = gen_decay;
+        spamp = gen_sp_amp;
+        sppha = gen_sp_pha;
+        ffamp = gen_ff_amp;
+        ffpha = gen_ff_pha;
+        slope = gen_pha_slope;
+    }catch(invalid_value_error& e){
+        message=std::string("Shape set ")+e.what();
+        return;
+    }
+
+    const Float64Vector::value_type& T = timebase.get();
+    size_t n = std::min(T.size(), gen_env.size());
+
+    shape::envelope(T.begin(), &gen_env[0], n, P);
+
+    genamp(sp_amp, spamp);
+    genamp(ff_amp, ffamp);
+    genpha(sp_pha, P.delay, sppha, slope);
+    genpha(ff_pha, P.delay, ffpha, slope);
+
+    tableready = true;
+}
+
+void drfm::genamp(Float64Vector& wf, double amp)
+{
+    Float64Vector::value_type& W = wf.get();
+    W.resize(gen_env.size());
+    shape::scale(&gen_env[0], W.begin(), W.size(), amp);
+    wf.setValid(true);
+    wf.markChanged();
+}
+
+void drfm::genpha(Float64Vector& wf, double t0, double offset, double slope)
+{
+    const Float64Vector::value_type& T = timebase.get();
+    Float64Vector::value_type& W = wf.get();
+    W.resize(T.size());
+    shape::phase(T.begin(), W.begin(), W.size(), t0, offset, slope);
+    wf.setValid(true);
+    wf.markChanged();
+}
+
 void drfm::senddata()
 {
+    if(shapeready) {
+        shapeready=false;
+        genshape();
+    }
+
     if(scalarready) {
         scalarready=false;
         sendscalar();
@@ -879,6 +1383,200 @@ void drfm::senddata()
     }
 }
 
+/* Called after each received message has been dispatched.
+ * Run one iteration of the learning controller for each measured
+ * field waveform, and step any ramps once per pulse (after the SP
+ * readback arrives).
+ * Changes are sent without waiting for a Commit.
+ */
+void drfm::endpulse()
+{
+    bool changed = false;
+
+    if(probeready) {
+        probeready=false;
+        changed |= learn();
+    }
+
+    if(pulseready) {
+        pulseready=false;
+        if(ramp_mode==0u)
+            changed |= stepRamps();
+    }
+
+    if(changed)
+        flush();
+}
+
+/* Ramp timer expired (Ramp Mode 1)
+ */
+void drfm::tick()
+{
+    if(ramp_mode!=1u) {
+        // back to per-pulse stepping.  See endpulse()
+        event_del(ramp_timo);
+        ramp_scheduled=false;
+        return;
+    }
+
+    if(stepRamps())
+        flush();
+
+    if(!ramp_gain_amp.active && !ramp_mo_high.active && !ramp_gen_sp_amp.active) {
+        event_del(ramp_timo);
+        ramp_scheduled=false;
+    }
+}
+
+/* Stats timer expired (1Hz)
+ *
+ * Publish link rates from the difference of the counters
+ * since the previous expiration, and the buffer depths.
+ */
+void drfm::stats()
+{
+    epicsTime now(epicsTime::getCurrent());
+    double dT = now-statsLast;
+    statsLast = now;
+    if(dT<=0.0)
+        return;
+
+    tx_rate     = (link.txbytes-linkprev.txbytes)/dT;
+    rx_rate     = (link.rxbytes-linkprev.rxbytes)/dT;
+    tx_msg_rate = (link.txmsgs-linkprev.txmsgs)/dT;
+    rx_msg_rate = (link.rxmsgs-linkprev.rxmsgs)/dT;
+    tx_deferred = epicsUInt32(link.txdeferred);
+    linkprev = link;
+
+    if(session) {
+        size_t depth = evbuffer_get_length(bufferevent_get_output(session));
+        if(depth>obuf_peak)
+            obuf_peak = depth;
+        tx_queue = epicsUInt32(depth);
+        rx_queue = epicsUInt32(evbuffer_get_length(bufferevent_get_input(session)));
+    } else {
+        tx_queue = 0u;
+        rx_queue = 0u;
+    }
+    // high water mark over the last period
+    tx_queue_max = epicsUInt32(obuf_peak);
+    obuf_peak = 0;
+
+    // total time spent not connected, including the present outage
+    downtime = downPrev + (connected ? 0.0 : now-downSince);
+}
+
+/* Send all pending changes as (at most) one scalar
+ * and one table message.
+ */
+void drfm::flush()
+{
+    dispatch();
+
+    if(shapeready) {
+        shapeready=false;
+        genshape();
+        dispatch();
+    }
+
+    if(scalarready) {
+        scalarready=false;
+        sendscalar();
+    }
+    if(tableready) {
+        tableready=false;
+        sendtable();
+    }
+}
+
+void drfm::startRamp()
+{
+    if(ramp_mode==1u && !ramp_scheduled) {
+        static const timeval period = {0, 100000};
+        event_add(ramp_timo, &period);
+        ramp_scheduled=true;
+    } else if(ramp_mode!=1u && ramp_scheduled) {
+        event_del(ramp_timo);
+        ramp_scheduled=false;
+    }
+}
+
+bool drfm::stepRamps()
+{
+    epicsTime now(epicsTime::getCurrent());
+
+    bool changed = false;
+    changed |= ramp_gain_amp.step(now);
+    changed |= ramp_mo_high.step(now);
+    changed |= ramp_gen_sp_amp.step(now);
+
+    return changed;
+}
+
+/* One learning control iteration.
+ *
+ * The error between the field setpoint and the measured (probe) field
+ * is low pass filtered and added, scaled by the gain of each loop,
+ * to the FF table.  Amplitude and phase errors differ in units
+ * (full scale vs. degrees), so each has its own gain.
+ *
+ * Returns true if the FF tables were updated.
+ */
+bool drfm::learn()
+{
+    // called every pulse.  Avoid throwing while settings are not yet valid
+    epicsUInt32 enable, conn, filter;
+    double again, pgain;
+    if(!ilc_enable.tryGet(enable) || !connected.tryGet(conn)
+            || !ilc_amp_gain.tryGet(again) || !ilc_pha_gain.tryGet(pgain)
+            || !ilc_filter.tryGet(filter))
+        return false;
+    if(!enable || !conn)
+        return false;
+    size_t width = filter;
+
+    bool amp = learn(ff_amp, sp_amp, probe_amp, ilc_amp_err, false, again, width);
+    bool pha = learn(ff_pha, sp_pha, probe_pha, ilc_pha_err, true, pgain, width);
+
+    if(!amp && !pha)
+        return false;
+
+    ilc_count = ilc_count + 1;
+    return true;
+}
+
+bool drfm::learn(Float64Vector& ff, const Float64Vector& sp, const Float64Vector& meas,
+                 Float64& rms, bool phase, double gain, size_t width)
+{
+    if(!sp.isValid() || !meas.isValid())
+        return false;
+
+    const Float64Vector::value_type& SP = sp.get();
+    const Float64Vector::value_type& M = meas.get();
+
+    size_t n = std::min(ilc_err.size(), std::min(SP.size(), M.size()));
+    if(n==0)
+        return false;
+
+    rms = ilc::error(SP.begin(), M.begin(), &ilc_err[0], n, phase);
+
+    ilc::smooth(&ilc_err[0], &ilc_filt[0], &ilc_sum[0], n, width);
+
+    // resize() also ensures that the array is not shared with a
+    // snapshot still held by a listener.
+    Float64Vector::value_type& FF = ff.get();
+    FF.resize(1000, 0.0);
+
+    if(phase)
+        ilc::correctPhase(FF.begin(), &ilc_filt[0], n, gain);
+    else
+        ilc::correct(FF.begin(), &ilc_filt[0], n, gain, 0.0, 1.0);
+
+    ff.setValid(true);
+    ff.markChanged();
+    return true;
+}
+
 void drfm::run()
 {
     Guard g(mutex());
@@ -905,18 +1603,50 @@ void drfm::stop()
         if(reconnect_scheduled) {
             evtimer_del(reconnect_timo);
         }
+        if(ramp_scheduled) {
+            event_del(ramp_timo);
+        }
+        event_del(stats_timo);
         event_base_loopexit(reactor, NULL);
     }
     runner.exitWait();
 }
 
+/* Keep setpoints in a persistent shared memory segment, and restore
+ * any saved by a previous run of this IOC.  Restored values are sent
+ * to the device on (re)connect, as are any other pending settings.
+ */
+void drfm::persistTo(const std::string& shmname)
+{
+    std::auto_ptr<shmExporter> P(new shmExporter(*this, shmname, true));
+
+    for(group::const_iterator it=settings.begin(), end=settings.end(); it!=end; ++it) {
+        // tables are always sent with 1000 points
+        P->add((*it)->name(), dynamic_cast<Float64Vector*>(*it) ? 1000u : 0u);
+    }
+
+    tableGuard g(*this, lockSiteIocsh);
+
+    size_t n = P->restore();
+    P->start();
+    persistent = P;
+
+    dispatch();
+
+    errlogPrintf("%s: restored %u of %u settings from %s\n", name().c_str(),
+                 (unsigned)n, (unsigned)settings.size(), shmname.c_str());
+}
+
 } // namespace ""
 
 extern "C"
-void createDRFM(const char* name, const char* host, int port, const char* type)
+void createDRFM(const char* name, const char* host, int port, const char* type, const char* persist)
 {
     try {
-        drfm::shared_pointer tbl(new drfm(name,host,port,type));
+        drfm *D = new drfm(name,host,port,type);
+        drfm::shared_pointer tbl(D);
+        if(persist && persist[0])
+            D->persistTo(persist);
         tbl->registerTable();
     }catch(std::exception& e){
         std::cerr<<"Failed to create DRFM table: "<<name<<": "<<e.what()<<"\n";
@@ -929,11 +1659,12 @@ static const iocshArg createDRFMArg0 = { "name",iocshArgString};
 static const iocshArg createDRFMArg1 = { "host",iocshArgString};
 static const iocshArg createDRFMArg2 = { "port",iocshArgInt};
 static const iocshArg createDRFMArg3 = { "type",iocshArgString};
-static const iocshArg * const createDRFMArgs[] = {&createDRFMArg0,&createDRFMArg1,&createDRFMArg2,&createDRFMArg3};
-static const iocshFuncDef createDRFMFuncDef = {"createDRFM",4,createDRFMArgs};
+static const iocshArg createDRFMArg4 = { "persist shm name",iocshArgString};
+static const iocshArg * const createDRFMArgs[] = {&createDRFMArg0,&createDRFMArg1,&createDRFMArg2,&createDRFMArg3,&createDRFMArg4};
+static const iocshFuncDef createDRFMFuncDef = {"createDRFM",5,createDRFMArgs};
 static void createDRFMCallFunc(const iocshArgBuf *args)
 {
-    createDRFM(args[0].sval,args[1].sval,args[2].ival,args[3].sval);
+    createDRFM(args[0].sval,args[1].sval,args[2].ival,args[3].sval,args[4].sval);
 }
 
 static
@@ -0,0 +1,67 @@
+
+#include <cmath>
+#include <algorithm>
+
+#include "ilc.h"
+
+namespace ilc {
+
+namespace {
+// into (-180, 180] degrees, without branching
+inline double wrapPhase(double v)
+{
+    return v - 360.0*std::ceil((v-180.0)/360.0);
+}
+}
+
+double error(const double *sp, const double *rb, double *err, size_t n, bool wrap)
+{
+    for(size_t i=0; i<n; i++)
+        err[i] = sp[i] - rb[i];
+
+    if(wrap) {
+        for(size_t i=0; i<n; i++)
+            err[i] = wrapPhase(err[i]);
+    }
+
+    double sumsq=0.0;
+    for(size_t i=0; i<n; i++)
+        sumsq += err[i]*err[i];
+
+    return n ? std::sqrt(sumsq/n) : 0.0;
+}
+
+void smooth(const double *in, double *out, double *sum, size_t n, size_t halfwidth)
+{
+    if(halfwidth==0) {
+        std::copy(in, in+n, out);
+        return;
+    }
+
+    // prefix sum so that each window is computed in constant time
+    sum[0]=0.0;
+    for(size_t i=0; i<n; i++)
+        sum[i+1] = sum[i] + in[i];
+
+    for(size_t i=0; i<n; i++) {
+        size_t lo = i>halfwidth ? i-halfwidth : 0;
+        size_t hi = std::min(n, i+halfwidth+1);
+        out[i] = (sum[hi]-sum[lo])/double(hi-lo);
+    }
+}
+
+void correct(double *ff, const double *err, size_t n, double gain, double lo, double hi)
+{
+    for(size_t i=0; i<n; i++) {
+        double v = ff[i] + gain*err[i];
+        ff[i] = std::max(lo, std::min(v, hi));
+    }
+}
+
+void correctPhase(double *ff, const double *err, size_t n, double gain)
+{
+    for(size_t i=0; i<n; i++)
+        ff[i] = wrapPhase(ff[i] + gain*err[i]);
+}
+
+} // namespace ilc
@@ -0,0 +1,47 @@
+#ifndef ILC_H
+#define ILC_H
+
+#include <stddef.h>
+
+/** @brief Iterative learning control kernels
+ *
+ * Element-wise operations on contiguous double arrays used to compute
+ * a feed forward correction from the error between the field setpoint
+ * and the measured (probe) field of the previous pulse.
+ *
+ * Loops are kept free of branches and aliasing so that they are
+ * vectorized by the compiler.
+ */
+namespace ilc {
+
+/** @brief Compute the tracking error err[i] = sp[i]-rb[i]
+ *
+ @param wrap If true, wrap the result into (-180,180] (phase in degrees)
+ @returns The RMS of the error
+ */
+double error(const double *sp, const double *rb, double *err, size_t n, bool wrap);
+
+/** @brief Centered moving average (zero phase low pass filter)
+ *
+ * Each output element is the mean of the input elements within
+ * halfwidth samples.  The window is truncated at the ends.
+ * A halfwidth of 0 copies the input.
+ *
+ @param sum Scratch space of n+1 elements
+ */
+void smooth(const double *in, double *out, double *sum, size_t n, size_t halfwidth);
+
+/** @brief Apply a correction ff[i] = clip(ff[i] + gain*err[i], lo, hi)
+ */
+void correct(double *ff, const double *err, size_t n, double gain, double lo, double hi);
+
+/** @brief Apply a phase correction ff[i] = wrap(ff[i] + gain*err[i])
+ *
+ * Phase is circular.  The result is wrapped into (-180,180] degrees,
+ * as by error(), instead of clipped.
+ */
+void correctPhase(double *ff, const double *err, size_t n, double gain);
+
+} // namespace ilc
+
+#endif // ILC_H
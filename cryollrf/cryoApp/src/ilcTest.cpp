@@ -0,0 +1,73 @@
+#include <cmath>
+
+#include <testMain.h>
+#include <epicsUnitTest.h>
+
+#include "ilc.h"
+
+namespace {
+
+bool near(double a, double b)
+{
+    return std::fabs(a-b)<1e-9;
+}
+
+void testError()
+{
+    testDiag("error() wraps the phase error");
+
+    double sp[3] = {170.0, -170.0, 180.0};
+    double rb[3] = {-170.0, 170.0, -180.0};
+    double err[3];
+
+    ilc::error(sp, rb, err, 3, true);
+    testOk(near(err[0], -20.0), "170 - -170 -> %g", err[0]);
+    testOk(near(err[1], 20.0), "-170 - 170 -> %g", err[1]);
+    testOk(near(err[2], 0.0), "180 - -180 -> %g", err[2]);
+}
+
+void testCorrectPhase()
+{
+    testDiag("correctPhase() wraps across 180 instead of sticking");
+
+    double ff[4] = {175.0, -175.0, 179.0, 0.0};
+    double err[4] = {10.0, -10.0, 1.0, 360.0};
+
+    ilc::correctPhase(ff, err, 4, 1.0);
+    testOk(near(ff[0], -175.0), "175 + 10 -> %g", ff[0]);
+    testOk(near(ff[1], 175.0), "-175 - 10 -> %g", ff[1]);
+    testOk(near(ff[2], 180.0), "179 + 1 -> %g", ff[2]);
+    testOk(near(ff[3], 0.0), "0 + 360 -> %g", ff[3]);
+
+    // repeated corrections keep moving, and stay in range
+    double p = 170.0, step = 5.0;
+    bool inrange = true;
+    for(unsigned i=0; i<8; i++) {
+        ilc::correctPhase(&p, &step, 1, 1.0);
+        inrange &= p>-180.0 && p<=180.0;
+    }
+    testOk(inrange && near(p, -150.0), "170 + 8*5 -> %g", p);
+}
+
+void testCorrectAmp()
+{
+    testDiag("correct() clamps amplitude");
+
+    double ff[2] = {0.95, 0.05};
+    double err[2] = {0.1, -0.1};
+
+    ilc::correct(ff, err, 2, 1.0, 0.0, 1.0);
+    testOk(near(ff[0], 1.0), "0.95 + 0.1 -> %g", ff[0]);
+    testOk(near(ff[1], 0.0), "0.05 - 0.1 -> %g", ff[1]);
+}
+
+} // namespace
+
+MAIN(ilcTest)
+{
+    testPlan(10);
+    testError();
+    testCorrectPhase();
+    testCorrectAmp();
+    return testDone();
+}
@@ -0,0 +1,63 @@
+
+#include <cmath>
+#include <algorithm>
+
+#include "shape.h"
+
+namespace shape {
+
+namespace {
+// index of the first sample at or after time x
+size_t firstAfter(const double *t, size_t n, double x)
+{
+    return std::lower_bound(t, t+n, x) - t;
+}
+}
+
+void envelope(const double *t, double *out, size_t n, const params& p)
+{
+    if(n==0)
+        return;
+
+    const double rise = p.delay, top = rise+p.fill, fall = top+p.flat;
+
+    const size_t i0 = firstAfter(t, n, rise),
+                 i1 = std::max(i0, firstAfter(t, n, top)),
+                 i2 = std::max(i1, firstAfter(t, n, fall));
+
+    for(size_t i=0; i<i0; i++)
+        out[i] = 0.0;
+
+    const double islope = p.fill>0.0 ? 1.0/p.fill : 0.0;
+    for(size_t i=i0; i<i1; i++)
+        out[i] = (t[i]-rise)*islope;
+
+    for(size_t i=i1; i<i2; i++)
+        out[i] = 1.0;
+
+    if(p.decay>0.0) {
+        // uniform sampling so each step is a constant factor
+        const double dt = n>1 ? t[1]-t[0] : 0.0,
+                     k = std::exp(-dt/p.decay);
+        double v = i2<n ? std::exp(-(t[i2]-fall)/p.decay) : 0.0;
+        for(size_t i=i2; i<n; i++, v*=k)
+            out[i] = v;
+    } else {
+        for(size_t i=i2; i<n; i++)
+            out[i] = 0.0;
+    }
+}
+
+void scale(const double *env, double *out, size_t n, double amp)
+{
+    for(size_t i=0; i<n; i++)
+        out[i] = amp*env[i];
+}
+
+void phase(const double *t, double *out, size_t n, double t0, double offset, double slope)
+{
+    for(size_t i=0; i<n; i++)
+        out[i] = offset + slope*std::max(0.0, t[i]-t0);
+}
+
+} // namespace shape
@@ -0,0 +1,47 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <stddef.h>
+
+/** @brief Parametric pulse shape generation
+ *
+ * Computes setpoint and feed forward tables from a few shape
+ * parameters.  All times are in the units of the time base (us).
+ *
+ @verbatim
+        ___________
+       /           \
+      /             `.
+ ____/                `-.___
+     |<-->|<-------->|<-->
+ delay fill   flat    decay
+ @endverbatim
+ */
+namespace shape {
+
+struct params {
+    //! Start of the fill ramp
+    double delay;
+    //! Duration of the linear fill ramp.  0 for a step.
+    double fill;
+    //! Duration of the flat top
+    double flat;
+    //! Exponential decay time constant after the flat top.  0 to drop to zero.
+    double decay;
+};
+
+/** @brief Compute the normalized (0 -> 1) amplitude envelope
+ *
+ @param t Time of each sample.  Must be uniformly spaced and increasing.
+ */
+void envelope(const double *t, double *out, size_t n, const params& p);
+
+//! out[i] = amp*env[i]
+void scale(const double *env, double *out, size_t n, double amp);
+
+//! out[i] = offset + slope*(t[i]-t0) for t[i]>=t0, otherwise offset
+void phase(const double *t, double *out, size_t n, double t0, double offset, double slope);
+
+} // namespace shape
+
+#endif // SHAPE_H
@@ -19,6 +19,12 @@ createDRFM("PB", "10.0.138.16", 10, "500MHz")
 #createDRFM("KLY2", "10.0.138.10", 10, "3GHz")
 #createDRFM("KLY3", "10.0.138.14", 10, "3GHz")
 #createDRFM("KLY4", "10.0.138.15", 10, "3GHz")
+# Optional 5th argument keeps setpoints in shared memory for a fast warm restart.
+# Output records of restored settings then start from the image, not autosave.
+# Also remove set_pass1_restoreFile("rf_settings.sav") below, which would put
+# the (older) autosave values back into scalar records after they initialize.
+# Autosave is still needed for a cold start after a host reboot.
+#createDRFM("PB", "10.0.138.16", 10, "500MHz", "/LN-LLRF-PB")
 
 ## Load record instances
 dbLoadRecords("db/drfm.db","P=LN-RF:PB{Cav},TBL=PB,MOSLO=14.06529064,MOOFF=-3.20221901,ADRVH=0.8,IDRVH=+1,IDRVL=-1,JDRVH=+1,JDRVL=-1")
@@ -44,6 +50,7 @@ set_savefile_path("${TOP}/as","/save")
 set_requestfile_path("${TOP}/as","/req")
 
 set_pass0_restoreFile("rf_settings.sav")
+# Remove with a warm restart image.  See createDRFM
 set_pass1_restoreFile("rf_settings.sav")
 set_pass0_restoreFile("rf_values.sav")
 set_pass1_restoreFile("rf_values.sav")
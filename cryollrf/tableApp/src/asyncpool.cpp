@@ -0,0 +1,193 @@
+
+#include <deque>
+#include <vector>
+#include <stdexcept>
+#include <cassert>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+#include <epicsStdio.h>
+#include <errlog.h>
+
+#include "paramtable/async.h"
+
+namespace paramTable {
+namespace {
+
+typedef epicsGuard<epicsMutex> Guard;
+typedef epicsGuardRelease<epicsMutex> UnGuard;
+typedef std::tr1::shared_ptr<detail::asyncJob> job_pointer;
+
+struct asyncPool;
+
+struct asyncWorker : public epicsThreadRunable {
+    asyncPool& pool;
+    epicsThread thread;
+
+    asyncWorker(asyncPool& pool, const char *name);
+    virtual ~asyncWorker() {}
+    virtual void run();
+};
+
+struct asyncPool {
+    epicsMutex lock;
+    epicsEvent wakeup;
+    std::deque<job_pointer> jobs;
+    std::vector<asyncWorker*> workers;
+    unsigned nworkers;
+    bool running;
+
+    asyncPool()
+        :nworkers(2)
+        ,running(true)
+    {}
+
+    // call with lock held
+    void start()
+    {
+        char name[20];
+        while(workers.size()<nworkers) {
+            epicsSnprintf(name, sizeof(name), "paramAsync%u", (unsigned)workers.size());
+            name[sizeof(name)-1] = '\0';
+            workers.push_back(new asyncWorker(*this, name));
+            workers.back()->thread.start();
+        }
+    }
+};
+
+asyncPool *pool;
+epicsThreadOnceId poolOnce = EPICS_THREAD_ONCE_INIT;
+
+void poolInit(void*)
+{
+    pool = new asyncPool;
+}
+
+asyncWorker::asyncWorker(asyncPool& pool, const char *name)
+    :pool(pool)
+    ,thread(*this, name,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            epicsThreadPriorityMedium)
+{}
+
+void asyncWorker::run()
+{
+    Guard g(pool.lock);
+    while(pool.running) {
+        if(pool.jobs.empty()) {
+            UnGuard u(g);
+            pool.wakeup.wait();
+            continue;
+        }
+
+        job_pointer job;
+        job.swap(pool.jobs.front());
+        pool.jobs.pop_front();
+        if(!pool.jobs.empty())
+            pool.wakeup.signal(); // more work for another worker
+
+        {
+            UnGuard u(g);
+            try {
+                job->run();
+            }catch(std::exception& e){
+                errlogPrintf("paramAsync: unhandled exception: %s\n", e.what());
+            }
+            job.reset(); // release outside of the pool lock
+        }
+    }
+    pool.wakeup.signal(); // pass shutdown to the next worker
+}
+
+} // namespace
+
+namespace detail {
+
+void async_mailbox_base::waitIdle()
+{
+    Guard g(lock);
+    while(running) {
+        UnGuard u(g);
+        idle.wait();
+    }
+}
+
+void async_subscription::disconnect()
+{
+    inline_sub->disconnect();
+    mailbox->cancel();
+    // the pool still holds the mailbox while queued or running
+    delete this;
+}
+
+void asyncQueue(const std::tr1::shared_ptr<asyncJob>& job)
+{
+    epicsThreadOnce(&poolOnce, &poolInit, 0);
+    {
+        Guard g(pool->lock);
+        if(!pool->running)
+            return;
+        pool->start();
+        pool->jobs.push_back(job);
+    }
+    pool->wakeup.signal();
+}
+
+} // namespace detail
+
+void disconnectAsync(subscription_type sub, epicsGuard<epicsMutex>& g)
+{
+    detail::async_subscription *A = dynamic_cast<detail::async_subscription*>(sub);
+    if(!A)
+        throw std::logic_error("Not an asynchronous listener");
+
+    table& tbl = A->param->getTable();
+    g.assertIdenticalMutex(tbl.mutex());
+    // releasing the lock within dispatch() would let others change the table
+    assert(!tbl.dispatching());
+
+    std::tr1::shared_ptr<detail::async_mailbox_base> mailbox(A->mailbox);
+    A->inline_sub->disconnect();
+    bool wait = mailbox->cancel();
+    delete A;
+
+    if(wait) {
+        // the listener may be waiting for the table lock
+        UnGuard u(g);
+        mailbox->waitIdle();
+    }
+}
+
+void asyncSetWorkers(unsigned n)
+{
+    epicsThreadOnce(&poolOnce, &poolInit, 0);
+    Guard g(pool->lock);
+    if(n==0)
+        n = 1;
+    if(!pool->workers.empty())
+        errlogPrintf("paramAsync: workers already started\n");
+    else
+        pool->nworkers = n;
+}
+
+void asyncShutdown()
+{
+    epicsThreadOnce(&poolOnce, &poolInit, 0);
+    std::vector<asyncWorker*> workers;
+    {
+        Guard g(pool->lock);
+        pool->running = false;
+        pool->jobs.clear();
+        workers.swap(pool->workers);
+    }
+    pool->wakeup.signal();
+
+    for(size_t i=0; i<workers.size(); i++) {
+        workers[i]->thread.exitWait();
+        delete workers[i];
+    }
+}
+
+} // namespace paramTable
@@ -0,0 +1,98 @@
+#include <limits>
+
+#include <testMain.h>
+#include <epicsUnitTest.h>
+
+#include "paramtable/scalar.h"
+
+using namespace paramTable;
+
+namespace {
+
+const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+struct testTable : public table {
+    Float64 scalar;
+    Float64Vector array;
+    testTable()
+        :table("deadbandTest")
+        ,scalar(*this, "scalar")
+        ,array(*this, "array")
+    {}
+};
+
+unsigned nscalar, narray;
+void onScalar(const valueBase&) {nscalar++;}
+void onArray(const valueBase&) {narray++;}
+
+void testScalarOps()
+{
+    typedef detail::deadband_ops<double> ops;
+    testDiag("Scalar deadband comparison with NaN");
+
+    testOk1(!ops::exceeds(1.05, 1.0, 0.1, 0.0));
+    testOk1(ops::exceeds(1.2, 1.0, 0.1, 0.0));
+    testOk(ops::exceeds(NaN, 1.0, 0.1, 0.0), "finite -> NaN");
+    testOk(ops::exceeds(1.0, NaN, 0.1, 0.0), "NaN -> finite");
+    testOk(!ops::exceeds(NaN, NaN, 0.1, 0.0), "NaN -> NaN");
+}
+
+void testArrayOps()
+{
+    typedef detail::deadband_ops<stride_data<double> > ops;
+    testDiag("Array deadband comparison with NaN");
+
+    stride_data<double> ref(100, 1.0), cur(100, 1.0);
+    testOk1(!ops::exceeds(cur, ref, 0.1, 0.0));
+
+    cur[70] = NaN;
+    testOk(ops::exceeds(cur, ref, 0.1, 0.0), "one element finite -> NaN");
+    testOk(ops::exceeds(ref, cur, 0.1, 0.0), "one element NaN -> finite");
+
+    ref[70] = NaN;
+    testOk(!ops::exceeds(cur, ref, 0.1, 0.0), "NaN -> NaN");
+}
+
+void testNotify()
+{
+    testDiag("A parameter with a deadband notifies NaN, and recovers");
+
+    testTable T;
+    Guard g(T.mutex());
+    T.scalar.connect(&onScalar);
+    T.array.connect(&onArray);
+    T.scalar.setDeadband(0.5);
+    T.array.setDeadband(0.5);
+
+    T.scalar = 1.0;
+    T.dispatch();
+    T.scalar = NaN;
+    T.dispatch();
+    testOk(nscalar==2, "NaN notified (%u)", nscalar);
+    T.scalar = NaN;
+    T.dispatch();
+    testOk(nscalar==2, "NaN again not notified (%u)", nscalar);
+    T.scalar = 1.0;
+    T.dispatch();
+    testOk(nscalar==3, "finite after NaN notified (%u)", nscalar);
+
+    T.array = Float64Vector::value_type(10, 1.0);
+    T.dispatch();
+    T.array.get().make_exclusive();
+    T.array.get()[3] = NaN;
+    T.array.markModified();
+    T.dispatch();
+    testOk(narray==2, "array NaN element notified (%u)", narray);
+}
+
+} // namespace
+
+MAIN(deadbandTest)
+{
+    testPlan(13);
+    table::tableOnce();
+    testScalarOps();
+    testArrayOps();
+    testNotify();
+    return testDone();
+}
@@ -39,6 +39,7 @@
 #include <stringinRecord.h>
 
 #include "paramtable/scalar.h"
+#include "paramtable/lockstats.h"
 
 namespace {
 
@@ -57,7 +58,7 @@ devset NAME = { \
     {6, \
      NULL, \
      (DEVSUPFUN) &dev_init_gbl<&dsxt ## NAME>::init_gbl, \
-     (DEVSUPFUN) &init_record_ ## INIT, \
+     (DEVSUPFUN) &dev_init<VALTYPE,RECTYPE>:: INIT, \
      (DEVSUPFUN) &dev_adddel<VALTYPE,RECTYPE>::get_iointr_info}, \
      (DEVSUPFUN) &dev_readwrite<VALTYPE,RECTYPE>:: IO ## _val \
 }
@@ -104,16 +105,6 @@ long init_gbl(int i)
 }
 };
 
-long init_record_empty(dbCommon*)
-{
-    return 0;
-}
-
-long init_record_return2(dbCommon*)
-{
-    return 2;
-}
-
 template<typename R>
 struct linktype {enum {value=0};};
 
@@ -252,6 +243,7 @@ struct dev_adddel {
 
             if(cmd==0 && !priv->subscribed) {
                 priv->subscription = priv->param->connect(std::tr1::bind(&callback_val<T>, priv, _1));
+                priv->subscription->setLabel(prec->name);
                 priv->subscribed=true;
             } else if(priv->subscribed) {
                 priv->param->disconnect(priv->subscription);
@@ -399,6 +391,37 @@ struct rec_ops<T,R,3> {
     }
 };
 
+template<typename T, typename R>
+struct dev_init {
+    static long empty(dbCommon*) {return 0;}
+    static long return2(dbCommon*) {return 2;}
+
+    /* Output records start from a value restored from a warm restart
+     * image (see shmExporter::restore()) in place of any autosave value.
+     * Otherwise as empty() or return2().
+     */
+    static
+    long restore(dbCommon* praw)
+    {
+        R* prec=(R*)praw;
+        if(!prec->dpvt)
+            return rec_ops<T,R>::assign_return;
+        try{
+            devPriv<T>* priv=(devPriv<T>*)prec->dpvt;
+
+            Guard g(priv->ptable->mutex());
+
+            if(priv->param->restored() && priv->param->isValid()) {
+                rec_ops<T,R>::assign(prec, priv->param->snapshot());
+                prec->udf = 0;
+            }
+        }catch(std::exception& e){
+            errlogPrintf("%s: init_record: %s\n", prec->name, e.what());
+        }
+        return rec_ops<T,R>::assign_return;
+    }
+};
+
 template<typename T, typename R>
 struct dev_readwrite {
 
@@ -410,32 +433,38 @@ struct dev_readwrite {
         try{
             devPriv<T>* priv=(devPriv<T>*)prec->dpvt;
 
-            Guard g(priv->ptable->mutex());
-
             typename devPriv<T>::sample_type last;
+            bool queued = false;
 
             {
                 Guard g(priv->devLock);
 
-                if(priv->buffer.empty())
-                    last = priv->param->snapshot();
-
-                else {
+                if(!priv->buffer.empty()) {
                     last = priv->buffer.back();
                     priv->buffer.pop_back();
+                    queued = true;
                 }
             }
 
-            rec_ops<T,R>::assign(prec, last);
+            // no table lock needed
+            if(!queued)
+                last = priv->param->published();
 
-            // capture and use return value to silence warning
-            bool x=recGblSetSevr(prec, READ_ALARM, last.severity);
-            if(prec->tse==epicsTimeEventDeviceTime && x==x) {
+            // also when invalid, so the alarm carries the time it was raised
+            if(prec->tse==epicsTimeEventDeviceTime)
                 prec->time = last.timestamp;
+
+            if(!last.valid()) {
+                // eg. disconnected.  Keep the last good VAL
+                (void)recGblSetSevr(prec, READ_ALARM, INVALID_ALARM);
+                return 2;
             }
 
+            rec_ops<T,R>::assign(prec, last);
+
+            (void)recGblSetSevr(prec, READ_ALARM, last.severity);
+
             return rec_ops<T,R>::assign_return;
-        }catch(invalid_value_error& e){
         }catch(std::exception& e){
             errlogPrintf("%s: read_val: %s\n", prec->name, e.what());
         }
@@ -451,7 +480,7 @@ struct dev_readwrite {
         try{
             devPriv<T>* priv=(devPriv<T>*)prec->dpvt;
 
-            Guard g(priv->ptable->mutex());
+            tableGuard g(*priv->ptable, lockSiteWrite);
 
             typename devPriv<T>::sample_type last;
 
@@ -482,8 +511,8 @@ struct dev_readwrite {
 // longout
 
 SELECT_REC_OUT(longoutRecord);
-DEVSUPPORT(devTblLOUInt32, longoutRecord, epicsUInt32, empty, write);
-DEVSUPPORT(devTblLOInt32,  longoutRecord, epicsInt32,  empty, write);
+DEVSUPPORT(devTblLOUInt32, longoutRecord, epicsUInt32, restore, write);
+DEVSUPPORT(devTblLOInt32,  longoutRecord, epicsInt32,  restore, write);
 
 // longin
 
@@ -494,9 +523,9 @@ DEVSUPPORT(devTblLIInt32,  longinRecord, epicsInt32,  empty, read);
 
 SELECT_REC_OUT(mbboRecord);
 SELECT_REC_OP(epicsUInt32, mbboRecord, 1);
-DEVSUPPORT(devTblMBBOUInt32, mbboRecord, epicsUInt32, empty, write);
+DEVSUPPORT(devTblMBBOUInt32, mbboRecord, epicsUInt32, restore, write);
 SELECT_REC_OP(epicsInt32, mbboRecord,  1);
-DEVSUPPORT(devTblMBBOInt32,  mbboRecord, epicsInt32,  empty, write);
+DEVSUPPORT(devTblMBBOInt32,  mbboRecord, epicsInt32,  restore, write);
 
 // mbbi
 
@@ -509,9 +538,9 @@ DEVSUPPORT(devTblMBBIInt32,  mbbiRecord, epicsInt32,  empty, read);
 
 SELECT_REC_OUT(mbboDirectRecord);
 SELECT_REC_OP(epicsUInt32, mbboDirectRecord, 1);
-DEVSUPPORT(devTblMBBODirectUInt32, mbboDirectRecord, epicsUInt32, empty, write);
+DEVSUPPORT(devTblMBBODirectUInt32, mbboDirectRecord, epicsUInt32, restore, write);
 SELECT_REC_OP(epicsInt32,  mbboDirectRecord, 1);
-DEVSUPPORT(devTblMBBODirectInt32,  mbboDirectRecord, epicsInt32,  empty, write);
+DEVSUPPORT(devTblMBBODirectInt32,  mbboDirectRecord, epicsInt32,  restore, write);
 
 // mbbiDirect
 
@@ -524,9 +553,9 @@ DEVSUPPORT(devTblMBBIDirectInt32,  mbbiDirectRecord, epicsInt32,  empty, read);
 
 SELECT_REC_OUT(boRecord);
 SELECT_REC_OP(epicsUInt32, boRecord, 1);
-DEVSUPPORT(devTblBOUInt32, boRecord, epicsUInt32, empty, write);
+DEVSUPPORT(devTblBOUInt32, boRecord, epicsUInt32, restore, write);
 SELECT_REC_OP(epicsInt32,  boRecord, 1);
-DEVSUPPORT(devTblBOInt32,  boRecord, epicsInt32,  empty, write);
+DEVSUPPORT(devTblBOInt32,  boRecord, epicsInt32,  restore, write);
 
 // bi
 
@@ -539,11 +568,11 @@ DEVSUPPORT(devTblBIInt32,  biRecord, epicsInt32,  empty, read);
 
 SELECT_REC_OUT(aoRecord);
 SELECT_REC_OP(epicsUInt32, aoRecord, 1);
-DEVSUPPORT(devTblAOUInt32, aoRecord, epicsUInt32, empty, write);
+DEVSUPPORT(devTblAOUInt32, aoRecord, epicsUInt32, restore, write);
 SELECT_REC_OP(epicsInt32,  aoRecord, 1);
-DEVSUPPORT(devTblAOInt32,  aoRecord, epicsInt32,  empty, write);
+DEVSUPPORT(devTblAOInt32,  aoRecord, epicsInt32,  restore, write);
 SELECT_REC_OP(epicsFloat64, aoRecord, 2);
-DEVSUPPORT(devTblAOFloat64, aoRecord, epicsFloat64, return2, write);
+DEVSUPPORT(devTblAOFloat64, aoRecord, epicsFloat64, restore, write);
 
 // ai
 
@@ -558,7 +587,7 @@ DEVSUPPORT(devTblAIFloat64, aiRecord, epicsFloat64, return2, read);
 
 SELECT_REC_OUT(stringoutRecord);
 SELECT_REC_OP(std::string, stringoutRecord, 3);
-DEVSUPPORT(devTblSOString, stringoutRecord, std::string, empty, write);
+DEVSUPPORT(devTblSOString, stringoutRecord, std::string, restore, write);
 
 // stringin
 
@@ -28,6 +28,7 @@
 #include <waveformRecord.h>
 
 #include "paramtable/scalar.h"
+#include "paramtable/lockstats.h"
 
 namespace {
 
@@ -212,12 +213,13 @@ struct dev_readwrite {
     typedef T* pointer_type;
 
     static inline
-    void subscribe(devPrivBase* bpriv, int cmd)
+    void subscribe(devPrivBase* bpriv, int cmd, const char *recname=0)
     {
         priv_type *priv=static_cast<priv_type*>(bpriv);
 
         if(cmd==0 && !priv->subscribed) {
             priv->subscription = priv->param->connect(std::tr1::bind(&callback_val<T>, priv, _1));
+            priv->subscription->setLabel(recname);
             priv->subscribed=true;
         } else if(priv->subscribed) {
             priv->param->disconnect(priv->subscription);
@@ -230,22 +232,29 @@ struct dev_readwrite {
     {
         priv_type* priv=static_cast<priv_type*>((devPrivBase*)prec->dpvt);
 
-        Guard g(priv->ptable->mutex());
-
         typename paramTable::value<T>::sample_type last;
+        bool queued = false;
 
         {
             Guard g(priv->devLock);
 
-            if(priv->buffer.empty())
-                last = priv->param->snapshot();
-
-            else {
+            if(!priv->buffer.empty()) {
                 last = priv->buffer.back();
                 priv->buffer.pop_back();
+                queued = true;
             }
         }
 
+        // no table lock needed
+        if(!queued)
+            last = priv->param->published();
+
+        if(!last.valid()) {
+            // eg. disconnected.  Keep the last good array
+            (void)recGblSetSevr(prec, READ_ALARM, INVALID_ALARM);
+            return 0;
+        }
+
         //Equivalent: prec->val = s.value;
 
         epicsUInt32 amount = last.value.size();
@@ -268,12 +277,53 @@ struct dev_readwrite {
 
     }
 
+    /* Until the IOC is running, a parameter restored from a warm restart
+     * image (see shmExporter::restore()) is copied to the record, in place
+     * of any autosave value.  Call with the table lock held.
+     * Returns true if copied.
+     */
+    static inline
+    bool readback(waveformRecord* prec)
+    {
+        priv_type* priv=static_cast<priv_type*>((devPrivBase*)prec->dpvt);
+        paramTable::value<T>& p = *priv->param;
+
+        if(!p.restored() || !p.isValid() || table::tableRunning())
+            return false;
+
+        epicsUInt32 amount = p.get().size();
+        if(amount>prec->nelm)
+            amount=prec->nelm;
+
+        std::copy(p.get().begin(),
+                  p.get().begin()+amount,
+                  static_cast<typename detail::primative<T>::type>(prec->bptr));
+
+        prec->nord=amount;
+        prec->udf=0;
+        return true;
+    }
+
+    static inline
+    long init_val(waveformRecord* prec)
+    {
+        priv_type* priv=static_cast<priv_type*>((devPrivBase*)prec->dpvt);
+
+        Guard g(priv->ptable->mutex());
+        readback(prec);
+        return 0;
+    }
+
     static inline
     long write_val(waveformRecord* prec)
     {
         priv_type* priv=(priv_type*)prec->dpvt;
 
-        Guard g(priv->ptable->mutex());
+        tableGuard g(*priv->ptable, lockSiteWrite);
+
+        // eg. PINI after autosave pass1
+        if(readback(prec))
+            return 0;
 
         paramTable::value<T>& p = *priv->param;
 
@@ -347,7 +397,7 @@ long get_iointr_info(int cmd, dbCommon *praw, IOSCANPVT *iopvt)
 
         switch(prec->ftvl) {
     #define OP(TYPE,type) \
-        case menuFtype ## TYPE: dev_readwrite<type>::subscribe(priv, cmd); break
+        case menuFtype ## TYPE: dev_readwrite<type>::subscribe(priv, cmd, prec->name); break
         OP(CHAR,Int8Vector::value_type);
         OP(UCHAR,UInt8Vector::value_type);
         OP(SHORT,Int16Vector::value_type);
@@ -393,6 +443,30 @@ try{
     return 0;
 }
 
+long init_record_restore(dbCommon* praw)
+{
+    waveformRecord* prec=(waveformRecord*)praw;
+    if(!prec->dpvt)
+        return 0;
+try{
+    switch(prec->ftvl) {
+#define OP(TYPE,type) case menuFtype ## TYPE: return dev_readwrite<type>::init_val(prec)
+    OP(CHAR,Int8Vector::value_type);
+    OP(UCHAR,UInt8Vector::value_type);
+    OP(SHORT,Int16Vector::value_type);
+    OP(USHORT,UInt16Vector::value_type);
+    OP(LONG,Int32Vector::value_type);
+    OP(ULONG,UInt32Vector::value_type);
+    OP(FLOAT,Float32Vector::value_type);
+    OP(DOUBLE,Float64Vector::value_type);
+#undef OP
+    }
+}catch(std::exception& e){
+    errlogPrintf("%s: init_record: %s\n", prec->name, e.what());
+}
+    return 0;
+}
+
 long write_val(waveformRecord* prec)
 {
     if(!prec->dpvt)
@@ -433,7 +507,7 @@ devset devTblWfOut = {
     {6,
      NULL,
      (DEVSUPFUN) &dev_init_gbl<&dsxtdevTblWf>::init_gbl,
-     (DEVSUPFUN) &init_record_empty,
+     (DEVSUPFUN) &init_record_restore,
      (DEVSUPFUN) &get_iointr_info},
      (DEVSUPFUN) &write_val
 };
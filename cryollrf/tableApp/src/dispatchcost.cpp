@@ -0,0 +1,113 @@
+
+#include <algorithm>
+#include <iomanip>
+
+#include <epicsAtomic.h>
+
+#include "paramtable/table.h"
+#include "paramtable/valueBase.h"
+
+namespace paramTable {
+
+namespace detail {
+int dispatchAccounting;
+}
+
+namespace {
+struct subscriberRow {
+    detail::subscription *sub;
+    const char *param;
+};
+
+bool moreParam(const std::pair<epicsUInt64,size_t>& a, const std::pair<epicsUInt64,size_t>& b)
+{
+    return a.first>b.first;
+}
+
+bool moreSubscriber(const subscriberRow& a, const subscriberRow& b)
+{
+    return a.sub->elapsed>b.sub->elapsed;
+}
+
+void showCost(std::ostream& strm, epicsUInt64 calls, epicsUInt64 elapsed)
+{
+    strm<<std::right<<std::setw(10)<<calls
+        <<std::setw(12)<<std::fixed<<std::setprecision(1)<<(calls ? elapsed*1e-3/calls : 0.0)
+        <<std::setw(12)<<std::setprecision(3)<<elapsed*1e-6<<"\n";
+}
+} // namespace
+
+void table::setDispatchAccounting(bool enable)
+{
+    epicsAtomicSetIntT(&detail::dispatchAccounting, enable ? 1 : 0);
+}
+
+bool table::dispatchAccounting()
+{
+    return epicsAtomicGetIntT(&detail::dispatchAccounting)!=0;
+}
+
+void table::showDispatchCosts(std::ostream& strm, size_t count, bool reset)
+{
+    Guard g(mutex());
+
+    strm<<name()<<": dispatch cost"<<(detail::dispatchAccounting ? "" : " (accounting disabled)")<<"\n";
+
+    std::vector<std::pair<epicsUInt64,size_t> > params;
+    for(size_t i=0; i<m_dispatchCosts.size(); i++) {
+        if(m_dispatchCosts[i].calls)
+            params.push_back(std::make_pair(m_dispatchCosts[i].elapsed, i));
+    }
+    size_t N = std::min(count, params.size());
+    std::partial_sort(params.begin(), params.begin()+N, params.end(), moreParam);
+
+    strm<<"  "<<std::left<<std::setw(30)<<"parameter"<<std::setw(20)<<""
+        <<std::right<<std::setw(10)<<"calls"<<std::setw(12)<<"mean (us)"<<std::setw(12)<<"total (ms)"<<"\n";
+    for(size_t n=0; n<N; n++) {
+        const detail::dispatchCost& C = m_dispatchCosts[params[n].second];
+        strm<<"  "<<std::left<<std::setw(50)<<m_params[params[n].second]->name();
+        showCost(strm, C.calls, C.elapsed);
+    }
+
+    std::vector<detail::subscription*> subs;
+    std::vector<subscriberRow> rows;
+    for(size_t i=0; i<m_params.size(); i++) {
+        subs.clear();
+        m_params[i]->subscriptions(subs);
+        for(size_t j=0; j<subs.size(); j++) {
+            subscriberRow R = {subs[j], m_params[i]->name().c_str()};
+            rows.push_back(R);
+        }
+    }
+    subs.clear();
+    m_globalListeners.subscriptions(subs);
+    for(size_t j=0; j<subs.size(); j++) {
+        subscriberRow R = {subs[j], "(any)"};
+        rows.push_back(R);
+    }
+    subs.clear();
+    m_changesetListeners.subscriptions(subs);
+    for(size_t j=0; j<subs.size(); j++) {
+        subscriberRow R = {subs[j], "(changeset)"};
+        rows.push_back(R);
+    }
+
+    N = std::min(count, rows.size());
+    std::partial_sort(rows.begin(), rows.begin()+N, rows.end(), moreSubscriber);
+
+    strm<<"  "<<std::left<<std::setw(30)<<"subscriber"<<std::setw(20)<<"of"
+        <<std::right<<std::setw(10)<<"calls"<<std::setw(12)<<"mean (us)"<<std::setw(12)<<"total (ms)"<<"\n";
+    for(size_t n=0; n<N && rows[n].sub->calls; n++) {
+        strm<<"  "<<std::left<<std::setw(30)<<(rows[n].sub->label ? rows[n].sub->label : "-")
+            <<std::setw(20)<<rows[n].param;
+        showCost(strm, rows[n].sub->calls, rows[n].sub->elapsed);
+    }
+
+    if(reset) {
+        std::fill(m_dispatchCosts.begin(), m_dispatchCosts.end(), detail::dispatchCost());
+        for(size_t n=0; n<rows.size(); n++)
+            rows[n].sub->calls = rows[n].sub->elapsed = 0u;
+    }
+}
+
+} // namespace paramTable
@@ -1,5 +1,8 @@
 
+#include <algorithm>
+
 #include "paramtable/group.h"
+#include "paramtable/scalar.h"
 
 #include <alarm.h>
 
@@ -10,22 +13,122 @@ namespace paramTable {
 group::group(table& o)
     :m_members()
     ,m_owner(&o)
-{}
+    ,m_sevOther(0)
+    ,m_summary(0)
+    ,m_summarySevr(NO_ALARM)
+{
+    std::fill(m_sevCount, m_sevCount+4, 0);
+}
 
-group::~group() {}
+group::~group()
+{
+    publishSummary(0);
+    FOREACHMEM(m) {
+        std::vector<group*>& G = (*m)->m_groups;
+        G.erase(std::remove(G.begin(), G.end(), this), G.end());
+    }
+}
 
 group& group::operator<<(valueBase& vb)
 {
-    m_members.insert(&vb);
+    if(&vb==m_summary)
+        throw std::logic_error("Group summary parameter can not be a member");
+    if(m_members.insert(&vb).second) {
+        vb.m_groups.push_back(this);
+        count(vb.severity(), 1);
+        updateSummary();
+    }
     return *this;
 }
 
 group& group::operator>>(valueBase& vb)
 {
-    m_members.erase(&vb);
+    if(m_members.erase(&vb)) {
+        std::vector<group*>& G = vb.m_groups;
+        G.erase(std::remove(G.begin(), G.end(), this), G.end());
+        count(vb.severity(), -1);
+        updateSummary();
+    }
     return *this;
 }
 
+void group::count(short sevr, int delta)
+{
+    if(sevr>=NO_ALARM && sevr<=INVALID_ALARM)
+        m_sevCount[sevr] += delta;
+    else
+        m_sevOther += delta;
+}
+
+// called by valueBase::setSeverity() of a member
+void group::severityChanged(short prev, short next)
+{
+    count(prev, -1);
+    count(next, 1);
+    updateSummary();
+}
+
+size_t group::severityCount(short s) const
+{
+    if(s>=NO_ALARM && s<=INVALID_ALARM)
+        return m_sevCount[s];
+    size_t n=0;
+    if(m_sevOther) {
+        FOREACHMEM(m) {
+            if((*m)->severity()==s)
+                n++;
+        }
+    }
+    return n;
+}
+
+short group::maxSeverity() const
+{
+    if(m_sevOther) {
+        short ret=NO_ALARM;
+        FOREACHMEM(m) {
+            ret = std::max(ret, (*m)->severity());
+        }
+        return ret;
+    }
+    for(short s=INVALID_ALARM; s>NO_ALARM; s--) {
+        if(m_sevCount[s])
+            return s;
+    }
+    return NO_ALARM;
+}
+
+void group::updateSummary()
+{
+    if(!m_summary)
+        return;
+    short s = maxSeverity();
+    if(s==m_summarySevr)
+        return;
+    m_summarySevr = s;
+    m_summary->get() = epicsUInt32(s);
+    m_summary->setSeverity(s);
+    m_summary->markChanged();
+}
+
+void group::publishSummary(value<epicsUInt32>* p)
+{
+    if(p && m_members.find(p)!=m_members.end())
+        throw std::logic_error("Group summary parameter can not be a member");
+    if(m_summary) {
+        std::vector<group*>& G = m_summary->m_summaryOf;
+        G.erase(std::remove(G.begin(), G.end(), this), G.end());
+    }
+    m_summary = p;
+    if(!p)
+        return;
+    p->m_summaryOf.push_back(this);
+    m_summarySevr = maxSeverity();
+    p->get() = epicsUInt32(m_summarySevr);
+    p->setSeverity(m_summarySevr);
+    p->markChanged();
+}
+
 void group::setSeverity(short s)
 {
     FOREACHMEM(m) {
@@ -53,23 +156,31 @@ bool compareSeverity(short a, group::op o, short b)
     }
 }
 
-bool group::allSeverity(op o, short s) const
+// number of members for which compareSeverity(severity,o,s) is true
+size_t group::countSeverity(op o, short s) const
 {
-    FOREACHMEM(m) {
-        short cur=(*m)->severity();
-        if(!compareSeverity(cur,o,s))
-            return false;
+    size_t n=0;
+    if(m_sevOther) {
+        FOREACHMEM(m) {
+            if(compareSeverity((*m)->severity(),o,s))
+                n++;
+        }
+    } else {
+        for(short cur=NO_ALARM; cur<=INVALID_ALARM; cur++) {
+            if(compareSeverity(cur,o,s))
+                n += m_sevCount[cur];
+        }
     }
-    return true;
+    return n;
+}
+
+bool group::allSeverity(op o, short s) const
+{
+    return countSeverity(o,s)==m_members.size();
 }
 bool group::anySeverity(op o, short s) const
 {
-    FOREACHMEM(m) {
-        short cur=(*m)->severity();
-        if(compareSeverity(cur,o,s))
-            return true;
-    }
-    return false;
+    return countSeverity(o,s)!=0;
 }
 
 bool group::allValid() const
@@ -160,6 +271,7 @@ namespace {
     void group_subscription::add(valueBase& vb, const valueBase::signal_t::callback_type& cb)
     {
         cons.push_back(vb.connect(cb));
+        cons.back()->setLabel("group");
     }
 
     void group_subscription::disconnect()
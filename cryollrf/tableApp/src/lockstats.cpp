@@ -0,0 +1,116 @@
+
+#include <string.h>
+
+#include <iomanip>
+
+#include <epicsAtomic.h>
+#include <epicsStdio.h>
+
+#include "paramtable/lockstats.h"
+
+namespace paramTable {
+
+const char* lockSiteName(lockSite s)
+{
+    switch(s) {
+    case lockSiteOther:   return "other";
+    case lockSiteReactor: return "reactor";
+    case lockSiteWrite:   return "write";
+    case lockSiteIocsh:   return "iocsh";
+    case lockSiteTimer:   return "timer";
+    default:              return "?";
+    }
+}
+
+namespace detail {
+
+void lockHistogram::reset()
+{
+    count = total = max = 0u;
+    memset(bucket, 0, sizeof(bucket));
+}
+
+double lockHistogram::percentile(double f) const
+{
+    epicsUInt64 need = epicsUInt64(f*count+0.5), sum = 0u;
+    for(unsigned k=0; k<buckets; k++) {
+        sum += bucket[k];
+        if(sum>=need)
+            return double(2u<<k);
+    }
+    return max*1e-3;
+}
+
+void lockStats::reset()
+{
+    for(unsigned i=0; i<lockSiteCount; i++) {
+        wait[i].reset();
+        hold[i].reset();
+    }
+    dispatch.reset();
+    since = epicsTime::getCurrent();
+    // depth is left alone.  tableGuard(s) may be active
+}
+
+} // namespace detail
+
+namespace {
+void showHist(std::ostream& strm, const detail::lockHistogram& H)
+{
+    if(H.count==0) {
+        strm<<std::setw(30)<<"-";
+        return;
+    }
+    strm<<std::setw(10)<<std::fixed<<std::setprecision(1)<<H.total*1e-3/H.count
+        <<std::setw(10)<<std::setprecision(0)<<H.percentile(0.99)
+        <<std::setw(10)<<std::setprecision(1)<<H.max*1e-3;
+}
+} // namespace
+
+void table::setLockProfile(bool enable)
+{
+    Guard g(mutex());
+    if(enable) {
+        if(!m_lockStats)
+            m_lockStats = new detail::lockStats;
+        else
+            m_lockStats->reset();
+    }
+    // stats are kept to print after disabling
+    epicsAtomicSetIntT(&m_lockProfile, enable ? 1 : 0);
+}
+
+void table::showLockStats(std::ostream& strm, bool reset)
+{
+    Guard g(mutex());
+    if(!m_lockStats) {
+        strm<<name()<<": lock profile not enabled\n";
+        return;
+    }
+    detail::lockStats& S = *m_lockStats;
+
+    strm<<name()<<": lock profile over "<<std::fixed<<std::setprecision(1)
+        <<(epicsTime::getCurrent()-S.since)<<" sec"
+        <<(m_lockProfile ? "" : " (stopped)")<<"\n";
+    strm<<std::left<<std::setw(10)<<"site"<<std::right<<std::setw(10)<<"count"
+        <<std::setw(30)<<"wait mean/p99/max (us)"
+        <<std::setw(30)<<"hold mean/p99/max (us)"<<"\n";
+    for(unsigned i=0; i<lockSiteCount; i++) {
+        if(S.wait[i].count==0)
+            continue;
+        strm<<std::left<<std::setw(10)<<lockSiteName(lockSite(i))<<std::right
+            <<std::setw(10)<<S.wait[i].count;
+        showHist(strm, S.wait[i]);
+        showHist(strm, S.hold[i]);
+        strm<<"\n";
+    }
+    strm<<std::left<<std::setw(10)<<"dispatch"<<std::right
+        <<std::setw(10)<<S.dispatch.count<<std::setw(30)<<"";
+    showHist(strm, S.dispatch);
+    strm<<"\n";
+
+    if(reset)
+        S.reset();
+}
+
+} // namespace paramTable
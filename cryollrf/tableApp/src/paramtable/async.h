@@ -0,0 +1,211 @@
+#ifndef PARAMTABLEASYNC_H
+#define PARAMTABLEASYNC_H
+
+#include <deque>
+#include <memory>
+#include <stdexcept>
+
+#include <tr1/memory>
+
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <errlog.h>
+
+#include "scalar.h"
+
+namespace paramTable {
+
+namespace detail {
+
+//! Unit of work run by the shared dispatch worker pool
+struct asyncJob {
+    virtual ~asyncJob() {}
+    virtual void run()=0;
+};
+
+//! Queue a job to be run by one of the pool workers
+void asyncQueue(const std::tr1::shared_ptr<asyncJob>& job);
+
+/* State of one asynchronous listener which does not depend on the value type.
+ * Kept alive by the pool while queued or running, so a call in progress
+ * may complete after the listener is disconnected.
+ */
+struct async_mailbox_base : public asyncJob {
+    epicsMutex lock;
+    bool scheduled, running, cancelled;
+    epicsThreadId runner; // worker calling the listener, while running
+    epicsEvent idle;      // signaled when a call ends after cancel()
+
+    async_mailbox_base()
+        :scheduled(false), running(false), cancelled(false)
+        ,runner(0)
+    {}
+    virtual ~async_mailbox_base() {}
+
+    /* Discard waiting updates and make no further calls.
+     * @returns true if a call is in progress on another thread
+     */
+    virtual bool cancel()=0;
+    //! Wait for a call in progress to return.  Call without the table lock
+    void waitIdle();
+};
+
+/* Holds the samples waiting for one asynchronous listener.
+ * Queued on the pool at most once at a time, so that calls
+ * to one listener are made in order, and never concurrently.
+ */
+template<typename T>
+class async_mailbox : public async_mailbox_base,
+                      public std::tr1::enable_shared_from_this<async_mailbox<T> >
+{
+public:
+    typedef callback<sample<T> > callback_type;
+
+    callback_type cb;
+    std::deque<sample<T> > pending;
+    size_t depth;
+
+    async_mailbox(const callback_type& cb, size_t depth)
+        :cb(cb), depth(depth ? depth : 1)
+    {}
+    virtual ~async_mailbox() {}
+
+    // called by table::dispatch() with the table lock held
+    void post(const value<T>& v)
+    {
+        epicsGuard<epicsMutex> g(lock);
+        if(cancelled)
+            return;
+        if(pending.size()<depth)
+            pending.push_back(v.snapshot());
+        else
+            pending.back() = v.snapshot(); // overflow, keep the latest
+
+        if(!scheduled) {
+            scheduled = true;
+            asyncQueue(this->shared_from_this());
+        }
+    }
+
+    // called by a pool worker without the table lock
+    virtual void run()
+    {
+        epicsGuard<epicsMutex> g(lock);
+        while(!cancelled && !pending.empty()) {
+            sample<T> S(pending.front());
+            pending.pop_front();
+            running = true;
+            runner = epicsThreadGetIdSelf();
+            {
+                epicsGuardRelease<epicsMutex> u(g);
+                try {
+                    cb(S);
+                }catch(std::exception& e){
+                    errlogPrintf("Unhandled exception in async listener: %s\n", e.what());
+                }
+            }
+            running = false;
+            runner = 0;
+            if(cancelled)
+                idle.signal();
+        }
+        scheduled = false;
+    }
+
+    virtual bool cancel()
+    {
+        epicsGuard<epicsMutex> g(lock);
+        cancelled = true;
+        pending.clear();
+        // unless made from within the call in progress
+        return running && runner!=epicsThreadGetIdSelf();
+    }
+};
+
+class async_subscription : public subscription {
+public:
+    valueBase *param;
+    subscription_type inline_sub;
+    std::tr1::shared_ptr<async_mailbox_base> mailbox;
+
+    async_subscription() :param(0), inline_sub(0) {}
+    virtual ~async_subscription() {}
+
+    /* Called with the table lock held, perhaps more than once or from
+     * within dispatch(), and so never releases it.  Does not wait for
+     * a call in progress.  See disconnectAsync()
+     */
+    virtual void disconnect();
+};
+
+} // namespace detail
+
+/** @brief Connect a listener which is run on the shared dispatch worker pool
+ *
+ * Instead of being called from table::dispatch() with the table lock held,
+ * the listener receives an immutable sample (a copy of the value, severity,
+ * and time stamp) on a worker thread, without the table lock.
+ *
+ * Calls to one listener are made in the order of updates, and never
+ * concurrently.  Different listeners may run concurrently.
+ * If more than 'depth' updates are waiting, the latest replaces
+ * the last waiting.
+ *
+ * The listener is called without the table lock, and should not lock the table.
+ * Use value::published() to read other parameters.
+ * Disconnect (made with the table lock held) stops further calls, but does
+ * not wait for a call in progress, which may complete afterwards.
+ * Use disconnectAsync() to wait for it before destroying objects the
+ * listener uses.
+ *
+ @code
+   connectAsync(tbl.amp, std::tr1::bind(&archiver::store, &arch, _1));
+ @endcode
+ */
+template<typename T>
+subscription_type connectAsync(value<T>& param,
+                               const typename detail::async_mailbox<T>::callback_type& cb,
+                               size_t depth=16)
+{
+    typedef detail::async_mailbox<T> mailbox_type;
+    std::auto_ptr<detail::async_subscription> sub(new detail::async_subscription);
+    std::tr1::shared_ptr<mailbox_type> mailbox(new mailbox_type(cb, depth));
+    sub->param = &param;
+    sub->mailbox = mailbox;
+    sub->inline_sub = param.connect(std::tr1::bind(&mailbox_type::post, mailbox.get(),
+                                                   std::tr1::placeholders::_1));
+    return sub.release();
+}
+
+/** @brief Disconnect a listener made by connectAsync(), and wait for
+ * a call in progress to return.
+ *
+ * The table lock is released during the wait, so must be held exactly once,
+ * by 'g', and not from within table::dispatch().  Otherwise the table would
+ * stay locked during the wait, or change in the middle of a dispatch.
+ * Made from within the listener itself, does not wait.
+ *
+ @code
+   Guard g(tbl.mutex());
+   disconnectAsync(sub, g);
+   delete arch; // no longer in use by the listener
+ @endcode
+ *
+ @throws std::logic_error if sub was not made by connectAsync()
+ */
+void disconnectAsync(subscription_type sub, epicsGuard<epicsMutex>& g);
+
+/** Set the number of dispatch worker threads.  Default 2.
+ *
+ * Only takes effect before the first asynchronous listener is notified.
+ */
+void asyncSetWorkers(unsigned n);
+
+//! Stop the dispatch worker threads.  Waiting work is discarded.
+void asyncShutdown();
+
+} // namespace paramTable
+
+#endif // PARAMTABLEASYNC_H
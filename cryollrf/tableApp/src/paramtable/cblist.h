@@ -2,9 +2,12 @@
 #define CBLIST_H
 
 #include <stdexcept>
-#include <set>
+#include <vector>
+#include <new>
 
 #include <errlog.h>
+#include <epicsTypes.h>
+#include <epicsTime.h>
 
 #include <tr1/functional>
 
@@ -14,20 +17,90 @@ template<class C>
 class callback_list;
 
 namespace detail {
+    // Non-zero while dispatch cost accounting is enabled.  See setDispatchAccounting()
+    extern int dispatchAccounting;
+
     //! Un-typed subscription.
     //! Allows disconnect() without knowing the type.
     struct subscription {
         virtual void disconnect()=0;
         virtual ~subscription();
+
+        /** Name this subscriber in dispatch cost reports.
+         @warning Captured as a pointer.  Must remain valid for the
+         *        life of the subscription (eg. a literal, or a record name).
+         */
+        void setLabel(const char *l){label=l;}
+
+        const char *label;
+        // Invocations and time spent (ns) while dispatchAccounting
+        epicsUInt64 calls, elapsed;
+
+        subscription() :label(0), calls(0), elapsed(0) {}
+    };
+
+    /* In place storage for a callable.
+     * Large enough for a bound member function pointer and a pointer,
+     * or a function pointer and two pointers.
+     */
+    union callback_storage {
+        char buf[4*sizeof(void*)];
+        void *p;
+        double d;
+        long l;
+        void (subscription::*m)();
     };
 
-    //! Holds a subscriber callback object
+    template<class C>
+    struct callback_ops {
+        void (*invoke)(callback_storage&, const C&);
+        void (*copy)(callback_storage& dst, const callback_storage& src);
+        void (*destroy)(callback_storage&);
+    };
+
+    // Small callables are stored in place
+    template<class C, typename F, bool local = sizeof(F)<=sizeof(callback_storage)>
+    struct callback_manager {
+        static F& get(callback_storage& s){return *reinterpret_cast<F*>(s.buf);}
+        static void init(callback_storage& s, const F& f){new (s.buf) F(f);}
+        static void invoke(callback_storage& s, const C& o){get(s)(o);}
+        static void copy(callback_storage& d, const callback_storage& s)
+        {new (d.buf) F(*reinterpret_cast<const F*>(s.buf));}
+        static void destroy(callback_storage& s){get(s).~F();}
+        static const callback_ops<C> ops;
+    };
+
+    // Large callables are allocated
+    template<class C, typename F>
+    struct callback_manager<C,F,false> {
+        static F& get(callback_storage& s){return *static_cast<F*>(s.p);}
+        static void init(callback_storage& s, const F& f){s.p = new F(f);}
+        static void invoke(callback_storage& s, const C& o){get(s)(o);}
+        static void copy(callback_storage& d, const callback_storage& s)
+        {d.p = new F(*static_cast<const F*>(s.p));}
+        static void destroy(callback_storage& s){delete static_cast<F*>(s.p);}
+        static const callback_ops<C> ops;
+    };
+
+    template<class C, typename F, bool local>
+    const callback_ops<C> callback_manager<C,F,local>::ops = {
+        &callback_manager::invoke,
+        &callback_manager::copy,
+        &callback_manager::destroy
+    };
+    template<class C, typename F>
+    const callback_ops<C> callback_manager<C,F,false>::ops = {
+        &callback_manager::invoke,
+        &callback_manager::copy,
+        &callback_manager::destroy
+    };
+
+    //! Holds a subscriber's position in a callback_list
     template<class C>
     class typed_subscription : public subscription {
         friend class callback_list<C>;
 
         typedef callback_list<C> list_type;
-        typedef std::tr1::function<void(const C&)> callback_type;
 
         virtual void disconnect()
         {
@@ -36,65 +109,228 @@ namespace detail {
         }
 
         list_type * const owner;
-        const callback_type cb;
+        size_t index;
+        bool pending; // index is in list_type::pending
 
-        typed_subscription(list_type& o, const callback_type& c)
-            : owner(&o), cb(c) {}
+        typed_subscription(list_type& o)
+            : owner(&o), index(0), pending(false) {}
 
         virtual ~typed_subscription(){}
     };
 }
 
+/** @brief A callable object taking a const C&
+ *
+ * Equivalent to std::tr1::function<void(const C&)>, except that
+ * callables no larger than a few pointers (eg. the result of
+ * std::tr1::bind() with a member function and object pointer)
+ * are stored in place without allocation.
+ */
+template<class C>
+class callback {
+    const detail::callback_ops<C> *m_ops;
+    detail::callback_storage m_store;
+public:
+    callback() :m_ops(0) {}
+    template<typename F>
+    callback(F f)
+    {
+        typedef detail::callback_manager<C,F> manager;
+        manager::init(m_store, f);
+        m_ops = &manager::ops;
+    }
+    callback(const callback& o) :m_ops(o.m_ops)
+    {
+        if(m_ops)
+            m_ops->copy(m_store, o.m_store);
+    }
+    ~callback()
+    {
+        if(m_ops)
+            m_ops->destroy(m_store);
+    }
+    callback& operator=(const callback& o)
+    {
+        if(this!=&o) {
+            if(m_ops)
+                m_ops->destroy(m_store);
+            m_ops = 0;
+            if(o.m_ops)
+                o.m_ops->copy(m_store, o.m_store);
+            m_ops = o.m_ops;
+        }
+        return *this;
+    }
+
+    bool empty() const{return !m_ops;}
+
+    void operator()(const C& o)
+    {
+        if(!m_ops)
+            throw std::tr1::bad_function_call();
+        m_ops->invoke(m_store, o);
+    }
+};
+
 typedef detail::subscription* subscription_type;
 
 /** Subscriber callback list.
  *
- * Holds a list of subscriptions.
+ * Holds a list of subscriptions in a contiguous array,
+ * invoked in the order they were connected.
+ *
+ * It is safe to connect or disconnect from within a callback.
+ * A disconnected entry is marked and removed after the
+ * outermost invocation completes.  A new subscription is
+ * first invoked on the next call.
  */
 template<class C>
 class callback_list
 {
     typedef detail::typed_subscription<C> typed_subscription;
 
-    typedef std::set<typed_subscription*> subscribers_t;
-    subscribers_t subscribers;
-
 public:
     typedef C object_type;
-    typedef typename typed_subscription::callback_type callback_type;
+    typedef callback<C> callback_type;
+
+private:
+    struct slot {
+        typed_subscription *token; // NULL when disconnected
+        callback_type cb;
+        slot(typed_subscription *t, const callback_type& c) :token(t), cb(c) {}
+    };
+    typedef std::vector<slot> slots_t;
+
+    slots_t subscribers;
+    slots_t pending; // connected during invocation
+    unsigned depth;  // nested invocations
+    size_t dead;     // disconnected entries in subscribers
+    size_t live;     // connected subscriptions
+
+    /* Remove disconnected entries and merge pending subscriptions.
+     * Only when not invoking, as callbacks may not be moved then.
+     */
+    void compact()
+    {
+        if(dead) {
+            size_t out=0;
+            for(size_t i=0; i<subscribers.size(); i++) {
+                if(!subscribers[i].token)
+                    continue;
+                if(out!=i)
+                    subscribers[out] = subscribers[i];
+                subscribers[out].token->index = out;
+                out++;
+            }
+            subscribers.erase(subscribers.begin()+out, subscribers.end());
+            dead = 0;
+        }
+        for(size_t i=0; i<pending.size(); i++) {
+            if(!pending[i].token)
+                continue;
+            pending[i].token->pending = false;
+            pending[i].token->index = subscribers.size();
+            subscribers.push_back(pending[i]);
+        }
+        pending.clear();
+    }
+
+    struct depthGuard {
+        callback_list& L;
+        depthGuard(callback_list& list) :L(list) {L.depth++;}
+        ~depthGuard() {
+            if(--L.depth==0 && (L.dead || !L.pending.empty()))
+                L.compact();
+        }
+    };
+
+public:
+    callback_list() :depth(0), dead(0), live(0) {}
 
     ~callback_list()
     {
+        compact();
         while(!subscribers.empty())
-            (*subscribers.begin())->disconnect();
+            static_cast<detail::subscription*>(subscribers.back().token)->disconnect();
     }
 
     //! Create a new subscription
     typed_subscription* connect(const callback_type& arg)
     {
-        typed_subscription *s=new typed_subscription(*this, arg);
-        if(subscribers.insert(s).second)
-            return s;
-        delete s;
-        throw std::logic_error("Duplicate subscription");
+        typed_subscription *s=new typed_subscription(*this);
+        try {
+            if(depth) {
+                s->pending = true;
+                s->index = pending.size();
+                pending.push_back(slot(s, arg));
+            } else {
+                s->index = subscribers.size();
+                subscribers.push_back(slot(s, arg));
+            }
+        } catch(...) {
+            delete s;
+            throw;
+        }
+        live++;
+        return s;
     }
 
     //! Cancel an existing subscription.
     //! After this call the callback will not be invoked.
     void disconnect(typed_subscription* subs)
     {
-        if(subscribers.erase(subs)==0)
+        slots_t& L = subs->pending ? pending : subscribers;
+        if(subs->owner!=this || subs->index>=L.size() || L[subs->index].token!=subs)
             throw std::logic_error("Not it subscription list");
+
+        L[subs->index].token = 0;
+        live--;
+        if(!subs->pending) {
+            if(depth==0 && subs->index+1==subscribers.size()) {
+                subscribers.pop_back();
+                return;
+            }
+            dead++;
+            if(depth==0)
+                compact();
+        }
+    }
+
+    //! Number of connected subscriptions
+    size_t size() const{return live;}
+
+    //! Append all connected subscriptions
+    void subscriptions(std::vector<detail::subscription*>& out) const
+    {
+        for(size_t i=0; i<subscribers.size(); i++)
+            if(subscribers[i].token)
+                out.push_back(subscribers[i].token);
+        for(size_t i=0; i<pending.size(); i++)
+            if(pending[i].token)
+                out.push_back(pending[i].token);
     }
 
     //! Pass the argument to all subscribers
     void operator()(const C& o)
     {
-        for(typename subscribers_t::const_iterator it=subscribers.begin();
-            it!=subscribers.end();
-            ++it)
+        depthGuard g(*this);
+        const bool account = detail::dispatchAccounting!=0;
+        // size fixed as new subscribers go to 'pending'
+        for(size_t i=0, N=subscribers.size(); i<N; i++)
         {
-            (*it)->cb(o);
+            slot& S = subscribers[i];
+            if(!S.token)
+                continue;
+            if(!account) {
+                S.cb(o);
+                continue;
+            }
+            epicsUInt64 start = epicsMonotonicGet();
+            S.cb(o);
+            if(S.token) { // may disconnect itself
+                S.token->calls++;
+                S.token->elapsed += epicsMonotonicGet()-start;
+            }
         }
     }
 };
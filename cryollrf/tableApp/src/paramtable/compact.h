@@ -0,0 +1,331 @@
+#ifndef PARAMTABLECOMPACT_H
+#define PARAMTABLECOMPACT_H
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+#include <tr1/unordered_map>
+
+#include <alarm.h>
+#include <epicsTypes.h>
+#include <epicsTime.h>
+
+#include "valueBase.h"
+#include "scalar.h"
+
+namespace paramTable {
+
+template<typename T>
+class compact_params;
+
+/** @brief One element of a compact_params, passed to element listeners
+ *
+ * Only valid during the callback.
+ */
+template<typename T>
+struct compact_element {
+    const compact_params<T>& params;
+    size_t index;
+
+    compact_element(const compact_params<T>& p, size_t i) :params(p), index(i) {}
+
+    const T& value() const{return params.get(index);}
+    short severity() const{return params.severity(index);}
+    const epicsTime& timestamp() const{return params.timestamp(index);}
+    const std::string& name() const{return params.name(index);}
+};
+
+/** @brief A large number of scalar parameters in parallel arrays.
+ *
+ * For tables with tens of thousands of scalar values (eg. aggregated
+ * from many boards) where a value<T> for each would be dominated by
+ * per-parameter overhead.
+ *
+ * Values, severities, time stamps, and changed flags are stored in
+ * parallel arrays indexed by the element index returned by add().
+ * Names and listener lists are kept apart, and listener lists are only
+ * allocated for elements which have listeners.
+ *
+ * The compact_params is itself a parameter of its table.  Changing any
+ * element queues it for table::dispatch(), which then notifies the
+ * listeners of each changed element, followed by the un-typed
+ * listeners of the whole.  Elements are not visible to device support.
+ *
+ * As with value<T>, all methods must be called with the table lock held.
+ *
+ @code
+   class aggregator : public table {
+   public:
+       compact_params<epicsFloat64> amps;
+       aggregator() :table("agg"), amps(*this, "amps") {
+           for(...)
+               amps.add(name);
+       }
+   };
+   ...
+   amps.assign(first, buf, count, now);
+   dispatch();
+ @endcode
+ */
+template<typename T>
+class compact_params : public valueBase
+{
+public:
+    typedef T value_type;
+    typedef compact_element<T> element_type;
+    typedef callback_list<element_type> signal_t;
+
+    //! Returned by find() when no element has the name
+    static const size_t npos = (size_t)-1;
+
+private:
+    // hot, indexed by element
+    std::vector<T> m_values;
+    std::vector<short> m_severities;
+    std::vector<epicsTime> m_stamps;
+    std::vector<epicsUInt32> m_changedBits; // bit (i%32) of word (i/32)
+    std::vector<size_t> m_changedList;      // in order of first change
+    std::vector<size_t> m_dispatching;      // swapped with m_changedList
+
+    // cold
+    std::vector<std::string> m_names;
+    typedef std::tr1::unordered_map<std::string, size_t> lookup_t;
+    lookup_t m_lookup;
+    typedef std::tr1::unordered_map<size_t, signal_t*> listeners_t;
+    listeners_t m_listeners;
+
+    void mark(size_t i)
+    {
+        epicsUInt32 mask = 1u<<(i%32u);
+        if(!(m_changedBits[i/32u]&mask)) {
+            m_changedBits[i/32u] |= mask;
+            m_changedList.push_back(i);
+        }
+        markChanged();
+    }
+
+    void check(size_t i) const
+    {
+        if(i>=m_values.size())
+            throw std::out_of_range("compact_params element index out of range");
+    }
+
+    compact_params(const compact_params&);
+    compact_params& operator=(const compact_params&);
+public:
+    compact_params(table& t, const std::string& n)
+        :valueBase(t, n)
+    {
+        m_severity = NO_ALARM;
+    }
+
+    virtual ~compact_params()
+    {
+        for(typename listeners_t::iterator it=m_listeners.begin(); it!=m_listeners.end(); ++it)
+            delete it->second;
+    }
+
+    virtual const std::type_info& elementType() const{return typeid(compact_params);}
+
+    //! Allocate for the expected number of elements
+    void reserve(size_t n)
+    {
+        m_values.reserve(n);
+        m_severities.reserve(n);
+        m_stamps.reserve(n);
+        m_names.reserve(n);
+        m_changedBits.reserve((n+31u)/32u);
+    }
+
+    /** Add a new element, initially INVALID_ALARM.
+     *
+     * @returns The index of the new element
+     * @throws std::logic_error if the name is already used
+     */
+    size_t add(const std::string& name)
+    {
+        size_t i = m_values.size();
+        if(!m_lookup.insert(std::make_pair(name, i)).second)
+            throw std::logic_error(std::string("Element name ")+name+" already added");
+        try {
+            m_names.push_back(name);
+            m_values.push_back(detail::defaultValue<T>::get());
+            m_severities.push_back(INVALID_ALARM);
+            m_stamps.push_back(epicsTime());
+            m_changedBits.resize((m_values.size()+31u)/32u, 0u);
+        }catch(...){
+            m_lookup.erase(name);
+            m_names.resize(i);
+            m_values.resize(i);
+            m_severities.resize(i);
+            m_stamps.resize(i);
+            throw;
+        }
+        return i;
+    }
+
+    //! Number of elements
+    size_t size() const{return m_values.size();}
+
+    //! Element index by name, or npos
+    size_t find(const std::string& name) const
+    {
+        typename lookup_t::const_iterator it = m_lookup.find(name);
+        return it==m_lookup.end() ? npos : it->second;
+    }
+
+    const std::string& name(size_t i) const{return m_names[i];}
+    using valueBase::name;
+
+    const T& get(size_t i) const{return m_values[i];}
+    short severity(size_t i) const{return m_severities[i];}
+    const epicsTime& timestamp(size_t i) const{return m_stamps[i];}
+    bool isChanged(size_t i) const{return (m_changedBits[i/32u]>>(i%32u))&1u;}
+    using valueBase::severity;
+    using valueBase::timestamp;
+    using valueBase::isChanged;
+
+    sample<T> snapshot(size_t i) const{return sample<T>(m_values[i], m_severities[i], m_stamps[i]);}
+
+    //! Assign element value, and mark valid
+    void set(size_t i, const T& v)
+    {
+        check(i);
+        throwIfNotWritable();
+        if(!notifyOnChange() || m_severities[i]==INVALID_ALARM || m_values[i]!=v)
+            mark(i);
+        m_values[i] = v;
+        if(m_severities[i]==INVALID_ALARM) // aka. setValid()
+            m_severities[i] = NO_ALARM;
+    }
+
+    using valueBase::setSeverity;
+    using valueBase::setTimestamp;
+
+    void setSeverity(size_t i, short sevr)
+    {
+        check(i);
+        if(m_severities[i]==sevr)
+            return;
+        m_severities[i] = sevr;
+        mark(i);
+    }
+
+    //! Set new timestamp.  Must be later then previous timestamp, or ignored
+    void setTimestamp(size_t i, const epicsTime& t)
+    {
+        check(i);
+        if(t<=m_stamps[i])
+            return;
+        m_stamps[i] = t;
+        mark(i);
+    }
+
+    void update(size_t i, const sample<T>& S)
+    {
+        set(i, S.value);
+        setSeverity(i, S.severity);
+        setTimestamp(i, S.timestamp);
+    }
+
+    /** Bulk update of 'count' consecutive elements starting at 'first',
+     * all with the same severity and time stamp.
+     */
+    void assign(size_t first, const T* vals, size_t count,
+                const epicsTime& t, short sevr=NO_ALARM)
+    {
+        if(count==0)
+            return;
+        check(first+count-1);
+        throwIfNotWritable();
+        const bool onchange = notifyOnChange();
+        for(size_t i=first, j=0; j<count; i++, j++) {
+            bool changed = !onchange || m_values[i]!=vals[j] || m_severities[i]!=sevr;
+            m_values[i] = vals[j];
+            m_severities[i] = sevr;
+            if(t>m_stamps[i]) {
+                m_stamps[i] = t;
+                changed = true;
+            }
+            if(changed)
+                mark(i);
+        }
+    }
+
+    //! Connect a listener to one element
+    connection_t connect(size_t i, const typename signal_t::callback_type& cb)
+    {
+        check(i);
+        signal_t *& L = m_listeners[i];
+        if(!L)
+            L = new signal_t;
+        return L->connect(cb);
+    }
+    using valueBase::connect;
+
+    virtual void show(std::ostream &strm, int lvl) const
+    {
+        valueBase::show(strm);
+        strm<<m_values.size()<<" elements";
+        if(lvl>1) {
+            for(size_t i=0; i<m_values.size(); i++)
+                strm<<"\n  "<<m_names[i]<<"\t= "<<m_values[i];
+        }
+    }
+
+    virtual void subscriptions(std::vector<detail::subscription*>& out)
+    {
+        for(typename listeners_t::const_iterator it=m_listeners.begin(); it!=m_listeners.end(); ++it)
+            it->second->subscriptions(out);
+        valueBase::subscriptions(out);
+    }
+
+    /** @brief Do not call directly.  Rather use table::dispatch()
+     *
+     * Invokes the listeners of each changed element
+     */
+    virtual void dispatch()
+    {
+        if(m_active || !valueBase::isChanged())
+            return;
+        bool ro=!writable();
+
+        m_dispatching.clear();
+        m_dispatching.swap(m_changedList);
+        for(size_t n=0; n<m_dispatching.size(); n++) {
+            size_t i = m_dispatching[n];
+            m_changedBits[i/32u] &= ~(1u<<(i%32u));
+        }
+
+        {
+            if(!ro)
+                setWritable(false);
+            flagGuard g(m_active);
+            try {
+                if(!m_listeners.empty()) {
+                    for(size_t n=0; n<m_dispatching.size(); n++) {
+                        typename listeners_t::const_iterator it = m_listeners.find(m_dispatching[n]);
+                        if(it!=m_listeners.end())
+                            (*it->second)(element_type(*this, m_dispatching[n]));
+                    }
+                }
+                valueBase::dispatch();
+            }catch(...){
+                if(!ro)
+                    setWritable(true);
+                throw;
+            }
+            if(!ro)
+                setWritable(true);
+        }
+
+        // elements changed by listeners are notified on the next pass
+        if(!m_changedList.empty())
+            markChanged();
+    }
+};
+
+} // namespace paramTable
+
+#endif // PARAMTABLECOMPACT_H
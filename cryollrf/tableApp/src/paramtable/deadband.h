@@ -0,0 +1,151 @@
+#ifndef PARAMTABLEDEADBAND_H
+#define PARAMTABLEDEADBAND_H
+
+#include <algorithm>
+#include <cstring>
+
+#include <tr1/type_traits>
+
+#include <epicsTypes.h>
+
+#include "stridedata.h"
+
+namespace paramTable {
+namespace detail {
+
+/* Comparison of a new value with the last notified value.
+ *
+ * An element has changed when |new-old| > max(abs, rel*|old|),
+ * or when exactly one of new and old is NaN.
+ *
+ * Only supported for arithmetic scalars, and arrays of them.
+ * Other types (std::string) compare for any difference.
+ */
+template<typename T, bool num = std::tr1::is_arithmetic<T>::value>
+struct deadband_ops {
+    enum {supported=0};
+    static bool exceeds(const T& cur, const T& ref, double, double){return cur!=ref;}
+    static void keep(T& ref, const T& cur){ref = cur;}
+};
+
+template<typename T>
+struct deadband_ops<T,true> {
+    enum {supported=1};
+    static bool exceeds(const T& cur, const T& ref, double abs, double rel)
+    {
+        double c = double(cur), r = double(ref);
+        if(c!=c || r!=r)
+            return !(c!=c && r!=r);
+        double d = c-r, m = r;
+        d = d<0.0 ? -d : d;
+        m = m<0.0 ? -m : m;
+        return d > std::max(abs, rel*m);
+    }
+    static void keep(T& ref, const T& cur){ref = cur;}
+};
+
+template<typename E>
+struct deadband_ops<stride_data<E>,false> {
+    enum {supported=1};
+    /* Elements are compared a block at a time, without branching
+     * within a block, so that the compiler can vectorize the inner loop.
+     */
+    static bool exceeds(const stride_data<E>& cur, const stride_data<E>& ref,
+                        double abs, double rel)
+    {
+        enum {block=64};
+        if(cur.size()!=ref.size())
+            return true;
+        const E *a = cur.begin(), *b = ref.begin();
+        const size_t N = cur.size();
+        for(size_t i=0; i<N; i+=block) {
+            const size_t end = std::min(N, i+size_t(block));
+            int any = 0;
+            for(size_t j=i; j<end; j++) {
+                double d = double(a[j])-double(b[j]), m = double(b[j]);
+                d = d<0.0 ? -d : d;
+                m = m<0.0 ? -m : m;
+                double t = rel*m;
+                t = t>abs ? t : abs;
+                // d is NaN if either is.  Changed unless both are
+                int nan = (d!=d) & ((a[j]==a[j]) | (b[j]==b[j]));
+                any |= (d>t) | nan;
+            }
+            if(any)
+                return true;
+        }
+        return false;
+    }
+    //! Copy contents.  The reference array is never shared.
+    static void keep(stride_data<E>& ref, const stride_data<E>& cur)
+    {
+        if(ref.size()!=cur.size())
+            ref = stride_data<E>(cur.size());
+        std::copy(cur.begin(), cur.end(), ref.begin());
+    }
+};
+
+//! Deadband settings of a value<T>, and the last notified value
+template<typename T>
+struct deadband {
+    typedef deadband_ops<T> ops;
+
+    double abs, rel;
+    T ref;
+    bool primed; // ref is valid
+
+    deadband() :abs(0.0), rel(0.0), ref(), primed(false) {}
+
+    //! True if cur differs from the last notified value by more than the deadband
+    bool exceeds(const T& cur) const
+    {
+        return !primed || ops::exceeds(cur, ref, abs, rel);
+    }
+
+    void notified(const T& cur)
+    {
+        ops::keep(ref, cur);
+        primed = true;
+    }
+};
+
+/* Copy of the last notified content of an array parameter with
+ * notifyOnChange() set.  Lets value<T>::markModified() detect an
+ * unchanged array exactly, by a byte comparison with the copy.
+ *
+ * Nothing is kept for other types, which compare by value.
+ */
+template<typename T>
+struct content_ref {
+    enum {supported=0};
+    bool same(const T&) const{return false;}
+    void notified(const T&) {}
+    void reset() {}
+};
+
+template<typename E>
+struct content_ref<stride_data<E> > {
+    enum {supported=1};
+
+    stride_data<E> ref; // never shared
+    bool primed;
+
+    content_ref() :ref(), primed(false) {}
+
+    bool same(const stride_data<E>& v) const
+    {
+        return primed && v.size()==ref.size()
+                && (v.size()==0 || std::memcmp(v.begin(), ref.begin(), v.size()*sizeof(E))==0);
+    }
+    void notified(const stride_data<E>& v)
+    {
+        deadband_ops<stride_data<E> >::keep(ref, v);
+        primed = true;
+    }
+    void reset(){primed = false;}
+};
+
+} // namespace detail
+} // namespace paramTable
+
+#endif // PARAMTABLEDEADBAND_H
@@ -5,6 +5,8 @@
 
 #include <set>
 
+#include <epicsTypes.h>
+
 #include <tr1/functional>
 
 namespace paramTable {
@@ -17,12 +19,29 @@ class table;
  * @link paramTable::valueBase un-typed parameters @endlink .
  *
  * Presents an interface similar to paramTable::valueBase.
+ *
+ * The number of members with each severity is kept up to date
+ * as member severities change, so severity queries do not
+ * visit the members.
  */
 class group {
     typedef std::set<valueBase*> m_members_t;
     m_members_t m_members;
 
     table *m_owner;
+
+    // number of members with each severity NO_ALARM through INVALID_ALARM
+    size_t m_sevCount[4];
+    // number of members with any other severity
+    size_t m_sevOther;
+
+    value<epicsUInt32> *m_summary;
+    short m_summarySevr;
+
+    friend class valueBase;
+    void count(short sevr, int delta);
+    void severityChanged(short prev, short next);
+    void updateSummary();
 public:
     typedef valueBase::connection_t connection_t;
     typedef m_members_t::const_iterator const_iterator;
@@ -41,6 +60,20 @@ public:
 
     size_t size() const{return m_members.size();}
 
+    //! @brief Number of members with the given severity
+    size_t severityCount(short) const;
+    //! @brief Highest severity of any member.  NO_ALARM if empty
+    short maxSeverity() const;
+
+    /** @brief Keep a parameter updated with maxSeverity()
+     *
+     * The parameter is given the value, and severity, of the highest
+     * member severity.  It is changed only when the highest severity changes.
+     * The parameter may not be a member.  Pass NULL to stop.
+     * Stops automatically if the parameter is destroyed first.
+     */
+    void publishSummary(value<epicsUInt32>* p);
+
     const_iterator begin() const{return m_members.begin();}
     const_iterator end() const{return m_members.end();}
 
@@ -51,6 +84,9 @@ public:
 
     //! @brief Comparison operations
     enum op {LT, LE, EQ, GE, GT, NE};
+private:
+    size_t countSeverity(op, short) const;
+public:
 
     //! @brief True if severities of all parameters match
     bool allSeverity(op, short) const;
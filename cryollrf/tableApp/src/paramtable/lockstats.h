@@ -0,0 +1,125 @@
+#ifndef PARAMTABLELOCKSTATS_H
+#define PARAMTABLELOCKSTATS_H
+
+#include <ostream>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsAtomic.h>
+
+#include "table.h"
+
+namespace paramTable {
+
+/** @brief Table lock call site categories
+ *
+ * Recorded by tableGuard when lock profiling is enabled.
+ * See table::setLockProfile()
+ */
+enum lockSite {
+    lockSiteOther,   //!< Not otherwise categorized
+    lockSiteReactor, //!< Driver I/O thread (socket and timer callbacks)
+    lockSiteWrite,   //!< Device support write_val() (record processing)
+    lockSiteIocsh,   //!< Shell commands
+    lockSiteTimer,   //!< paramTable timers (eg. rate limit flush)
+    lockSiteCount
+};
+
+//! Short name of a lockSite
+const char* lockSiteName(lockSite);
+
+namespace detail {
+
+/* log2 histogram of durations.
+ * Bucket k counts [2^k, 2^(k+1)) us.  Bucket 0 also counts < 1 us.
+ */
+struct lockHistogram {
+    enum {buckets=24};
+    epicsUInt64 count, total, max; // ns
+    epicsUInt32 bucket[buckets];
+
+    lockHistogram() {reset();}
+
+    void reset();
+
+    void add(epicsUInt64 ns)
+    {
+        count++;
+        total += ns;
+        if(ns>max)
+            max = ns;
+        unsigned k = 0;
+        for(epicsUInt64 us = ns/1000u; us>1u && k<buckets-1u; us>>=1)
+            k++;
+        bucket[k]++;
+    }
+
+    //! Upper edge (us) of the bucket containing the given fraction (0-1) of samples
+    double percentile(double) const;
+};
+
+// Only accessed with the table lock held
+struct lockStats {
+    lockHistogram wait[lockSiteCount], hold[lockSiteCount];
+    lockHistogram dispatch; // time in table::dispatch()
+    unsigned depth;         // tableGuard nesting in the owning thread
+    epicsTime since;
+
+    lockStats() :depth(0), since(epicsTime::getCurrent()) {}
+    void reset();
+};
+
+} // namespace detail
+
+/** @brief Lock a table, accounting wait and hold time by call site.
+ *
+ * Use in place of Guard(tbl.mutex()) where the call site category is known.
+ * When profiling is disabled costs only a test.  Since the table lock is
+ * recursive, only the outermost tableGuard in a thread records.
+ *
+ @code
+   tableGuard g(*ctrl, lockSiteReactor);
+   ctrl->recvdata();
+   ctrl->dispatch();
+ @endcode
+ */
+class tableGuard {
+    table& m_table;
+    const lockSite m_site;
+    detail::lockStats *m_stats; // NULL when not profiling
+    epicsUInt64 m_acquired;     // zero unless outermost
+
+    tableGuard(const tableGuard&);
+    tableGuard& operator=(const tableGuard&);
+public:
+    tableGuard(table& t, lockSite site)
+        :m_table(t)
+        ,m_site(site)
+        ,m_stats(0)
+        ,m_acquired(0)
+    {
+        // only a hint.  Tested again with the lock held
+        epicsUInt64 start = epicsAtomicGetIntT(&t.m_lockProfile) ? epicsMonotonicGet() : 0u;
+        t.mutex().lock();
+        if(t.m_lockProfile && t.m_lockStats) {
+            m_stats = t.m_lockStats;
+            if(m_stats->depth++==0u && start) {
+                m_acquired = epicsMonotonicGet();
+                m_stats->wait[site].add(m_acquired-start);
+            }
+        }
+    }
+    ~tableGuard()
+    {
+        if(m_stats) {
+            if(m_acquired)
+                m_stats->hold[m_site].add(epicsMonotonicGet()-m_acquired);
+            m_stats->depth--;
+        }
+        m_table.mutex().unlock();
+    }
+};
+
+} // namespace paramTable
+
+#endif // PARAMTABLELOCKSTATS_H
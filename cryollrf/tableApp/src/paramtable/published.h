@@ -0,0 +1,154 @@
+#ifndef PARAMTABLEPUBLISHED_H
+#define PARAMTABLEPUBLISHED_H
+
+#include <tr1/type_traits>
+
+#include <epicsAtomic.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+
+namespace paramTable {
+namespace detail {
+
+/** @brief A copy of a parameter readable without the table lock.
+ *
+ * Written only by table::dispatch(), with the table lock held.
+ * Any number of threads may read concurrently with one writer.
+ *
+ * Arithmetic types use a sequence lock.  A reader retries if
+ * the writer was active during its copy.
+ */
+template<typename T, bool plain = std::tr1::is_arithmetic<T>::value>
+class published_cell {
+    size_t m_seq; // odd while writing
+    T m_value;
+    short m_severity;
+    epicsTimeStamp m_stamp;
+
+    published_cell(const published_cell&);
+    published_cell& operator=(const published_cell&);
+public:
+    published_cell(const T& v, short sevr)
+        :m_seq(0), m_value(v), m_severity(sevr)
+    {m_stamp.secPastEpoch = m_stamp.nsec = 0;}
+
+    void publish(const T& v, short sevr, const epicsTime& t)
+    {
+        size_t seq = m_seq;
+        epicsAtomicSetSizeT(&m_seq, seq+1);
+        epicsAtomicWriteMemoryBarrier();
+
+        epicsTimeStamp ts(t);
+        const_cast<volatile T&>(m_value) = v;
+        const_cast<volatile short&>(m_severity) = sevr;
+        const_cast<volatile epicsUInt32&>(m_stamp.secPastEpoch) = ts.secPastEpoch;
+        const_cast<volatile epicsUInt32&>(m_stamp.nsec) = ts.nsec;
+
+        epicsAtomicWriteMemoryBarrier();
+        epicsAtomicSetSizeT(&m_seq, seq+2);
+    }
+
+    void read(T& v, short& sevr, epicsTime& t) const
+    {
+        epicsTimeStamp ts;
+        while(true) {
+            size_t seq = epicsAtomicGetSizeT(&m_seq);
+            epicsAtomicReadMemoryBarrier();
+
+            v = const_cast<const volatile T&>(m_value);
+            sevr = const_cast<const volatile short&>(m_severity);
+            ts.secPastEpoch = const_cast<const volatile epicsUInt32&>(m_stamp.secPastEpoch);
+            ts.nsec = const_cast<const volatile epicsUInt32&>(m_stamp.nsec);
+
+            epicsAtomicReadMemoryBarrier();
+            if(!(seq&1) && seq==epicsAtomicGetSizeT(&m_seq))
+                break;
+        }
+        t = ts;
+    }
+};
+
+/* Other types (std::string, stride_data) can not be copied while
+ * being assigned.  Instead the writer fills one of three copies
+ * which no reader holds, then makes it current.  A reader counts
+ * itself on the current copy, and retries if the current copy
+ * changed before it was counted.
+ *
+ * stride_data copies share the array.  Writers already call resize()
+ * or make_exclusive() before modifying an array in place.
+ */
+template<typename T>
+class published_cell<T,false> {
+    struct slot {
+        T value;
+        short severity;
+        epicsTime stamp;
+    };
+    slot m_slots[3];
+    mutable int m_readers[3];
+    int m_current;
+
+    published_cell(const published_cell&);
+    published_cell& operator=(const published_cell&);
+public:
+    published_cell(const T& v, short sevr)
+        :m_current(0)
+    {
+        for(int i=0; i<3; i++) {
+            m_slots[i].value = v;
+            m_slots[i].severity = sevr;
+            m_readers[i] = 0;
+        }
+    }
+
+    void publish(const T& v, short sevr, const epicsTime& t)
+    {
+        while(true) {
+            for(int i=0; i<3; i++) {
+                if(i==m_current)
+                    continue;
+                // compare-and-swap used as a full barrier around the load
+                if(epicsAtomicCmpAndSwapIntT(&m_readers[i], 0, 0)!=0)
+                    continue;
+
+                m_slots[i].value = v;
+                m_slots[i].severity = sevr;
+                m_slots[i].stamp = t;
+
+                epicsAtomicWriteMemoryBarrier();
+                epicsAtomicSetIntT(&m_current, i);
+                return;
+            }
+            // readers hold both other copies.  They will be done shortly
+            epicsThreadSleep(0.0);
+        }
+    }
+
+    void read(T& v, short& sevr, epicsTime& t) const
+    {
+        int i;
+        while(true) {
+            i = epicsAtomicGetIntT(&m_current);
+            epicsAtomicIncrIntT(&m_readers[i]);
+            if(epicsAtomicGetIntT(&m_current)==i)
+                break;
+            epicsAtomicDecrIntT(&m_readers[i]);
+        }
+        epicsAtomicReadMemoryBarrier();
+
+        try {
+            v = m_slots[i].value;
+            sevr = m_slots[i].severity;
+            t = m_slots[i].stamp;
+        }catch(...){
+            epicsAtomicDecrIntT(&m_readers[i]);
+            throw;
+        }
+        epicsAtomicDecrIntT(&m_readers[i]);
+    }
+};
+
+} // namespace detail
+} // namespace paramTable
+
+#endif // PARAMTABLEPUBLISHED_H
@@ -7,6 +7,8 @@
 
 #include "stridedata.h"
 #include "valueBase.h"
+#include "published.h"
+#include "deadband.h"
 
 namespace paramTable {
 
@@ -82,8 +84,27 @@ public:
 private:
     value_type m_value;
 
+    detail::published_cell<T> m_published;
+
+    // NULL unless setDeadband()
+    detail::deadband<T> *m_deadband;
+
+    // arrays only.  Content as of the last notification when notifyOnChange()
+    detail::content_ref<T> m_content;
+
     signal_t m_typedListeners;
 
+    // names the table hook in dispatch cost reports.  Empty without one
+    std::string m_hookLabel;
+
+    // Would assigning v need notification
+    template<typename U>
+    bool needsNotify(const U& v) const {
+        if(m_deadband)
+            return !isValid() || m_deadband->exceeds(v);
+        return !notifyOnChange() || !isValid() || v!=m_value;
+    }
+
     value(const value&);
     value& operator=(const value&);
 public:
@@ -92,21 +113,29 @@ public:
     value(C& t, const std::string& n)
         :valueBase(t,n)
         ,m_value(detail::defaultValue<T>::get())
+        ,m_published(m_value, m_severity)
+        ,m_deadband(0)
+        ,m_content()
     {
         setNotifyOnChange(detail::defMarkChanged<T>::value);
     }
     //! Create a new parameter and register a member function of the table
-    //! as a listener.
+    //! as a listener.  It is labeled in dispatch cost reports (tblDispatchStats)
+    //! with 'label', or by default the full name of the parameter and " hook".
     template<typename C, typename FN>
-    value(C& t, const std::string& n, FN fn)
+    value(C& t, const std::string& n, FN fn, const std::string& label=std::string())
         :valueBase(t,n)
         ,m_value(detail::defaultValue<T>::get())
+        ,m_published(m_value, m_severity)
+        ,m_deadband(0)
+        ,m_content()
+        ,m_hookLabel(label.empty() ? fullName()+" hook" : label)
     {
         setNotifyOnChange(detail::defMarkChanged<T>::value);
-        connect(std::tr1::bind(fn, &t));
+        connect(std::tr1::bind(fn, &t))->setLabel(m_hookLabel.c_str());
     }
 
-    virtual ~value(){}
+    virtual ~value(){delete m_deadband;}
 
     //! Access to the type info for the value type.
     virtual const std::type_info& elementType() const{return typeid(T);}
@@ -115,13 +144,63 @@ public:
     template<typename U>
     value& operator=(U v) {
         throwIfNotWritable();
-        if(!notifyOnChange() || !isValid() || v!=m_value)
+        if(needsNotify(v))
             markChanged();
         m_value=v;
         setValid();
         return *this;
     }
 
+    /** Suppress notification of small changes.
+     *
+     * A new value is notified only when it differs from the last notified
+     * value by more than max(abs, rel*|last|).  For arrays, when any
+     * element does.  A change of severity is always notified.  A newer
+     * time stamp alone is not.
+     *
+     * Takes the place of notifyOnChange() while set.  Pass zero for both
+     * to remove.  The next new value after setting is always notified.
+     *
+     * Only for arithmetic types and arrays of them.
+     * @throws std::logic_error for other types
+     */
+    void setDeadband(double abs, double rel=0.0)
+    {
+        if(!detail::deadband_ops<T>::supported)
+            throw std::logic_error(fullName()+": deadband not supported for this type");
+        if(abs<=0.0 && rel<=0.0) {
+            delete m_deadband;
+            m_deadband = 0;
+            return;
+        }
+        if(!m_deadband)
+            m_deadband = new detail::deadband<T>;
+        m_deadband->abs = abs;
+        m_deadband->rel = rel;
+        m_deadband->primed = false;
+    }
+    //! Absolute deadband, or zero
+    double deadbandAbs() const{return m_deadband ? m_deadband->abs : 0.0;}
+    //! Relative deadband, or zero
+    double deadbandRel() const{return m_deadband ? m_deadband->rel : 0.0;}
+
+    /** Mark changed after modifying the value in place through get().
+     *
+     * Unlike markChanged(), when a deadband is set only marks changed
+     * if the new content differs from the last notified by more than the deadband.
+     * For arrays with notifyOnChange() set, only if the content differs
+     * from the last notified, compared with a copy of it.
+     */
+    void markModified()
+    {
+        if(m_deadband) {
+            if(m_deadband->exceeds(m_value))
+                markChanged();
+        } else if(!notifyOnChange() || !m_content.same(m_value)) {
+            markChanged();
+        }
+    }
+
     template<typename U>
     bool operator==(U v) const {
         return v==m_value;
@@ -151,23 +230,56 @@ public:
      *
      @warning It is the responsibility of the caller to ensure that any modifications
      * to the referenced object are safe, and that the value is marked as changed
-     * with markChanged().
+     * with markChanged() or markModified().
      */
     T& get() { return m_value; }
     const T& get() const { return m_value; }
 
+    /** Copy the current value, unless the severity is INVALID_ALARM.
+     *
+     * The non-throwing alternative to the implicit conversion.
+     @returns false, and leaves 'v' unchanged, if not valid.
+     */
+    bool tryGet(T& v) const
+    {
+        if(!isValid())
+            return false;
+        v = m_value;
+        return true;
+    }
+
     //! Create a snapshot of the current value, severity, and timestamp
     sample<T> snapshot() const{return sample<T>(m_value, m_severity, m_stamp);}
 
-    //! Update using value, severity, and timestamp from the given sample
-    void update(const sample<T>& v) {
+    /** Copy of the value, severity, and timestamp as of the last dispatch()
+     *
+     * Unlike all other methods, may be called without locking the table.
+     * Never blocks on the table lock.
+     */
+    sample<T> published() const {
+        sample<T> ret;
+        m_published.read(ret.value, ret.severity, ret.timestamp);
+        return ret;
+    }
+
+    /** Update using value, severity, and timestamp from the given sample
+     *
+     * @returns true if listeners will be notified of this update
+     */
+    bool update(const sample<T>& v) {
         throwIfNotWritable();
-        if(!notifyOnChange() || v.value!=m_value || v.severity!=m_severity || v.timestamp>m_stamp)
+        bool notify;
+        if(m_deadband)
+            notify = v.severity!=m_severity || m_deadband->exceeds(v.value);
+        else
+            notify = !notifyOnChange() || v.value!=m_value || v.severity!=m_severity || v.timestamp>m_stamp;
+        if(notify)
             markChanged();
         m_value = v.value;
-        m_severity = v.severity;
+        setSeverity(v.severity);
         if(v.timestamp>m_stamp)
             m_stamp = v.timestamp;
+        return notify;
     }
 
     //! Connect a typed listener
@@ -179,6 +291,12 @@ public:
         strm<<m_value;
     }
 
+    virtual void subscriptions(std::vector<detail::subscription*>& out)
+    {
+        m_typedListeners.subscriptions(out);
+        valueBase::subscriptions(out);
+    }
+
     /** @brief Do not call directly.  Rather use table::dispatch()
      *
      * Responsible for invoking typed listeners
@@ -191,6 +309,16 @@ public:
         if(!ro)
             setWritable(false);
 
+        m_published.publish(m_value, m_severity, m_stamp);
+        if(m_deadband)
+            m_deadband->notified(m_value);
+        else if(detail::content_ref<T>::supported) {
+            if(notifyOnChange())
+                m_content.notified(m_value);
+            else
+                m_content.reset();
+        }
+
         flagGuard g(m_active);
         m_typedListeners(*this);
         valueBase::dispatch();
@@ -0,0 +1,106 @@
+#ifndef PARAMTABLESHMEXPORT_H
+#define PARAMTABLESHMEXPORT_H
+
+#include <string>
+#include <vector>
+
+#include "table.h"
+#include "valueBase.h"
+
+struct tblshm_param;
+
+namespace paramTable {
+
+/** @brief Mirror parameters of a table into POSIX shared memory
+ *
+ * For same host consumers (analysis scripts, feedback daemons) which
+ * would otherwise read through Channel Access.  See tblshm.h for the
+ * segment layout and the C reader library.
+ *
+ * Supports UInt32, Int32, Float64, and the array types.  Arrays longer
+ * than the capacity given to add() are truncated.
+ *
+ * The segment is updated by a changeset listener, so is current as of
+ * each table::dispatch().  It is removed when the exporter is destroyed,
+ * unless persistent.
+ *
+ * A persistent segment outlives the IOC process (until reboot), and
+ * serves as a warm restart image.  On the next start, restore() copies
+ * the saved values, severities, and time stamps back into the
+ * parameters before start() replaces the segment.
+ *
+ @code
+   shmExporter X(tbl, "/DRFM1");
+   X.add("FF Amp RB", 1000);
+   X.add("Temp");
+   X.start();
+ @endcode
+ */
+class shmExporter
+{
+    table& m_table;
+    const std::string m_name;
+    const bool m_persist;
+
+    struct entry {
+        valueBase *param;
+        unsigned type;
+        size_t elemSize, capacity;
+        size_t (*copy)(valueBase&, void*, size_t);
+        void (*restore)(valueBase&, const void*, size_t, const sampleBase&);
+        tblshm_param *shared; // in segment
+    };
+    std::vector<entry> m_entries;
+    std::vector<int> m_byIndex; // entry of table parameter index, or -1
+
+    char *m_base;
+    size_t m_size;
+    table::connection_t m_conn;
+
+    void update(entry&);
+    void changed(const changeset&);
+
+    shmExporter(const shmExporter&);
+    shmExporter& operator=(const shmExporter&);
+public:
+    /**
+     @param t The table, which must outlive the exporter
+     @param shmname POSIX shared memory name (eg. "/DRFM1")
+     @param persist If true, leave the segment in place when destroyed
+     */
+    shmExporter(table& t, const std::string& shmname, bool persist=false);
+    ~shmExporter();
+
+    /** Export a parameter.  Must be called before start()
+     *
+     @param capacity Maximum number of array elements.  Ignored for scalars.
+     *                 If zero, the current array length.
+     @throws std::runtime_error if the name is not found, or of an unsupported type
+     */
+    void add(const std::string& param, size_t capacity=0);
+
+    //! True if add() would accept this parameter
+    static bool supported(const valueBase&);
+
+    /** Restore added parameters from a segment left by a previous run.
+     * Must be called before start(), with the table lock held.
+     *
+     * Parameters are matched by name and type.  Entries which were being
+     * updated when the previous run stopped, and parameters which are not
+     * writable, are skipped.  Changes are notified on the next dispatch().
+     *
+     @returns The number of parameters restored.  Zero if there is no segment.
+     */
+    size_t restore();
+
+    /** Create the segment, write current values, and begin updates.
+     * Call with the table lock held.
+     */
+    void start();
+
+    const std::string& name() const{return m_name;}
+};
+
+} // namespace paramTable
+
+#endif // PARAMTABLESHMEXPORT_H
@@ -3,23 +3,100 @@
 
 #include <map>
 #include <list>
+#include <vector>
+#include <string>
+#include <typeinfo>
+#include <stdexcept>
+
+#include <tr1/unordered_map>
 
 #include <tr1/memory>
 #include <tr1/functional>
 
+#include <epicsTypes.h>
 #include <epicsMutex.h>
 #include <epicsGuard.h>
+#include <epicsTime.h>
+#include <epicsAtomic.h>
 
 #include "cblist.h"
+#include "trace.h"
 
 namespace paramTable {
 
 typedef epicsGuard<epicsMutex> Guard;
 
+class table;
 class valueBase;
+class tableGuard;
+
+namespace detail {
+struct lockStats;
+struct staging;
+
+// Time spent dispatching one parameter.  See table::setDispatchAccounting()
+struct dispatchCost {
+    epicsUInt64 calls, elapsed; // elapsed in ns
+    dispatchCost() :calls(0), elapsed(0) {}
+};
+}
+
 template<typename T>
 class value;
 
+/** @brief Typed reference to a parameter, resolved once
+ *
+ * Holds the owning table and the dense index assigned to the parameter
+ * when it was added.  Dereferencing is an array index, with no name
+ * lookup or type check.  A handle remains valid for the lifetime
+ * of the table.
+ *
+ * See table::resolve()
+ */
+template<typename T>
+class handle {
+    table *m_table;
+    size_t m_index;
+public:
+    handle() :m_table(0), m_index(0) {}
+    handle(table& t, size_t i) :m_table(&t), m_index(i) {}
+
+    //! True if this handle refers to a parameter
+    bool valid() const{return m_table!=0;}
+    //! Index of the parameter in its table.  See table::param()
+    size_t index() const{return m_index;}
+
+    inline value<T>& operator*() const;
+    value<T>* operator->() const{return &**this;}
+};
+
+/** @brief Parameters changed together
+ *
+ * Passed to listeners registered with table::connectChangeset()
+ * once for each table::dispatch() which notified any parameter.
+ *
+ * Owned by the table and reused.  Only valid during the callback.
+ */
+struct changeset {
+    //! The table containing the changed parameters
+    table *source;
+    //! Time stamp of the committed transaction, or the time of dispatch
+    epicsTime timestamp;
+    //! Indices of changed parameters in the order notified.  See table::param()
+    std::vector<size_t> indices;
+    //! Bit mask of changed parameters.  Bit (i%32) of word (i/32) for parameter i
+    std::vector<epicsUInt32> bits;
+
+    changeset() :source(0) {}
+
+    //! Test if the parameter with index i was changed
+    bool contains(size_t i) const {
+        return i/32u<bits.size() && (bits[i/32u]>>(i%32u))&1u;
+    }
+    //! Number of parameters changed
+    size_t size() const{return indices.size();}
+};
+
 /** @brief Container for a list of parameters.
  *
  * Holds several paramTable::value instances.  Keeps track of
@@ -36,6 +113,7 @@ public:
     typedef std::tr1::shared_ptr<table> shared_pointer;
 
     typedef callback_list<valueBase>  signal_t;
+    typedef callback_list<changeset>  changeset_signal_t;
     typedef subscription_type connection_t;
 
 protected:
@@ -47,20 +125,49 @@ private:
     shared_pointer m_parent;
     const std::tr1::shared_ptr<epicsMutex> m_guard;
 
-    typedef std::map<std::string, valueBase*> m_paramlookup_t;
+    // parameters in order of addition.  Position is valueBase::index()
+    std::vector<valueBase*> m_params;
+
+    typedef std::tr1::unordered_map<std::string, valueBase*> m_paramlookup_t;
     m_paramlookup_t m_paramlookup;
 
     std::list<valueBase*> m_cleanup;
 
-    std::list<valueBase*> m_changelist;
+    // intrusive queue of changed parameters linked through valueBase::m_nextChanged
+    valueBase *m_changedHead, *m_changedTail;
 
     bool m_active;
 
+    // traceCategory bits and level.  Atomic, see setTrace()
+    int m_traceMask;
+    int m_traceLevel;
+
     friend class valueBase;
+    friend class transaction;
 
     signal_t m_globalListeners;
+    changeset_signal_t m_changesetListeners;
+    changeset m_changeset;
+    bool m_changesetStampSet; // set by transaction::commit()
+    detail::staging *m_staging; // reused by transaction.  NULL until first needed
+
+    // parameters with notification held back by valueBase::setMaxRate()
+    std::vector<valueBase*> m_deferred;
+    struct flusher;
+    flusher *m_flusher; // NULL until first needed
+
+    // lock profiling.  See tableGuard
+    int m_lockProfile;
+    detail::lockStats *m_lockStats; // NULL until first enabled
+    friend class tableGuard;
+
+    // by parameter index.  Empty until dispatch accounting is first enabled
+    std::vector<detail::dispatchCost> m_dispatchCosts;
 
     void markChanged(valueBase&);
+    void defer(valueBase&, epicsUInt64 due, epicsUInt64 now);
+    void undefer(valueBase&);
+    void flushDeferred();
 
     void init();
 
@@ -81,25 +188,73 @@ public:
     void unregisterTable();
 
     void dispatch();
+    //! True within dispatch().  Call with the lock held
+    bool dispatching() const{return m_active;}
 
     const std::string& name() const{return m_instancename;}
 
+    /** Select which trace points are enabled.  See TBL_TRACE()
+     *
+     @param mask Bit mask of traceCategory
+     @param level Trace points with a level less than or equal to this are enabled
+     */
+    void setTrace(unsigned mask, int level)
+    {
+        epicsAtomicSetIntT(&m_traceLevel, level);
+        epicsAtomicSetIntT(&m_traceMask, int(mask));
+    }
+    //! Test if trace points of the given category and level are enabled
+    bool traceEnabled(unsigned cat, int lvl) const
+    {
+        return (unsigned(epicsAtomicGetIntT(&m_traceMask))&cat) && lvl<=epicsAtomicGetIntT(&m_traceLevel);
+    }
+
+    /** Enable or disable recording of lock wait and hold times by tableGuard,
+     * and of time spent in dispatch().  Enabling clears previous results.
+     */
+    void setLockProfile(bool);
+    bool lockProfile() const{return m_lockProfile!=0;}
+    //! Print lock profile.  Optionally clear afterwards
+    void showLockStats(std::ostream&, bool reset=false);
+
+    /** Enable or disable, for all tables, counting of the time spent
+     * in dispatch() on each parameter, and in each subscriber callback.
+     * When disabled costs a test per parameter and per callback.
+     */
+    static void setDispatchAccounting(bool);
+    static bool dispatchAccounting();
+    /** Print the 'count' parameters, and the 'count' subscriptions,
+     * which have taken the most time in dispatch().  Optionally clear afterwards
+     */
+    void showDispatchCosts(std::ostream&, size_t count, bool reset=false);
+
     //! Add a un-typed listener which receive notification for all parameters
     connection_t connect(const signal_t::callback_type& cb ){return m_globalListeners.connect(cb);}
     void disconnect(connection_t c){c->disconnect();}
 
+    /** Add a listener which receives one notification for each dispatch(),
+     * listing all parameters notified by it.  Called after all per-value listeners.
+     * A committed transaction is one dispatch().
+     */
+    connection_t connectChangeset(const changeset_signal_t::callback_type& cb ){return m_changesetListeners.connect(cb);}
+
     /** Request that the given function or function object
-     * be invoked for each parameter in this table.
+     * be invoked for each parameter in this table, in name order.
+     * Use param() to visit in index order.
      */
     template<typename C>
     void visitParams(C a) {
-        for(m_paramlookup_t::const_iterator it=m_paramlookup.begin();
-            it!=m_paramlookup.end();
-            ++it)
-        {
-            a(it->second);
-        }
+        std::vector<valueBase*> sorted(paramsByName());
+        for(size_t i=0; i<sorted.size(); i++)
+            a(sorted[i]);
     }
+    //! All parameters, sorted by name
+    std::vector<valueBase*> paramsByName() const;
+
+    //! Number of parameters in this table
+    size_t paramCount() const{return m_params.size();}
+    //! Access parameter by index.  See valueBase::index()
+    valueBase& param(size_t i) const{return *m_params[i];}
 
     virtual void add(const std::string& name, const std::type_info& t);
 
@@ -113,27 +268,35 @@ public:
     //! @brief Typed Lookup parameter by name.
     //! @returns NULL if not found
     template<typename T>
-    value<T>* tryFind(const std::string& n) const {
-        valueBase* b=tryFindBase(n);
-        if(!b)
-            return 0;
-        value<T>* t=dynamic_cast<value<T>* >(b);
-        if(!t)
-            return 0;
-        return t;
-    }
+    inline value<T>* tryFind(const std::string& n) const;
 
     //! @brief Typed Lookup parameter by name
     //! @throws std::runtime_error if not found
     template<typename T>
     value<T>& find(const std::string& n) const {
-        valueBase* b=&findBase(n);
-        value<T>* t=dynamic_cast<value<T>* >(b);
-        if(!t)
+        value<T>* t=tryFind<T>(n);
+        if(!t) {
+            findBase(n); // throws if not found
             throw std::logic_error("Incorrect type");
+        }
         return *t;
     }
 
+    //! @brief Typed Lookup parameter by name, returning a handle.
+    //! @returns An invalid handle if not found, or of a different type
+    template<typename T>
+    handle<T> tryResolve(const std::string& n) {
+        value<T>* t=tryFind<T>(n);
+        return t ? handle<T>(*this, t->index()) : handle<T>();
+    }
+
+    //! @brief Typed Lookup parameter by name, returning a handle.
+    //! @throws std::runtime_error if not found
+    template<typename T>
+    handle<T> resolve(const std::string& n) {
+        return handle<T>(*this, find<T>(n).index());
+    }
+
     /** Special notification called for all registered (see registerTable())
      * tables.
      * A good place to start worker threads.
@@ -156,10 +319,26 @@ public:
 private:
     static void tableOnce(void*);
 
+    /* The registered tables are kept in an immutable snapshot, sorted by name.
+     * Registration replaces the snapshot.  Readers (getTable(), visitTables())
+     * only lock to copy the snapshot pointer, and search or iterate without
+     * any lock.
+     */
     struct tableSingle {
-        typedef std::map<std::string, std::tr1::shared_ptr<table> > tables_t;
-        tables_t tables;
-        epicsMutex tablesGuard;
+        typedef std::pair<std::string, std::tr1::shared_ptr<table> > entry_t;
+        typedef std::vector<entry_t> tables_t;
+        typedef std::tr1::shared_ptr<const tables_t> snapshot_t;
+
+        snapshot_t tables;
+        epicsMutex snapshotGuard; // held only to copy or replace 'tables'
+        epicsMutex tablesGuard; // serializes registration and IOC state changes
+
+        tableSingle() :tables(new tables_t) {}
+
+        snapshot_t snapshot();
+        void replace(const snapshot_t& next);
+        static tables_t::const_iterator lowerBound(const tables_t& T, const std::string& name);
+        static tables_t::const_iterator find(const tables_t& T, const std::string& name);
     };
     static tableSingle* tableSingleton;
 
@@ -174,6 +353,13 @@ public:
     static void clearTables();
 };
 
+template<typename T>
+value<T>& handle<T>::operator*() const
+{
+    // type was checked by table::resolve()
+    return static_cast<value<T>&>(m_table->param(m_index));
+}
+
 class flagGuard {
     bool *f;
 public:
@@ -0,0 +1,112 @@
+#ifndef PARAMTABLETRACE_H
+#define PARAMTABLETRACE_H
+
+#include <stddef.h>
+
+namespace paramTable {
+
+/** @brief Trace categories
+ *
+ * Bit mask used to select which trace points of a table are enabled.
+ * See table::setTrace()
+ */
+enum traceCategory {
+    traceConnection = 0x1, //!< Connect/disconnect and socket events
+    traceSend       = 0x2, //!< Outgoing messages
+    traceReceive    = 0x4, //!< Incoming messages
+    traceDispatch   = 0x8, //!< Parameter updates and notification.  Level 2 and up
+    traceAll        = 0xffffffff
+};
+
+/** @brief One captured trace argument
+ *
+ * Arguments are copied by value when the trace point is hit
+ * and only formatted later by the trace thread.
+ *
+ @warning A string argument is captured as a pointer.
+ *          It must remain valid for the life of the IOC (eg. a literal,
+ *          or the name of a table).
+ */
+struct traceArg {
+    enum kind_t {Int, UInt, Double, String, Pointer};
+    kind_t kind;
+    union {
+        long i;
+        unsigned long u;
+        double d;
+        const char *s;
+        const void *p;
+    } v;
+
+    traceArg() :kind(Int) {v.i=0;}
+    traceArg(int x) :kind(Int) {v.i=x;}
+    traceArg(long x) :kind(Int) {v.i=x;}
+    traceArg(unsigned x) :kind(UInt) {v.u=x;}
+    traceArg(unsigned long x) :kind(UInt) {v.u=x;}
+    traceArg(double x) :kind(Double) {v.d=x;}
+    traceArg(const char *x) :kind(String) {v.s=x;}
+    traceArg(const void *x) :kind(Pointer) {v.p=x;}
+};
+
+enum {traceMaxArgs=4};
+
+/** @brief Queue one trace message
+ *
+ * Copies the format pointer and arguments into a ring buffer
+ * owned by the calling thread.  Does not lock, allocate (after the first call
+ * from a thread), or format.  If the ring is full the message is dropped
+ * and counted.
+ *
+ * Rings come from a bounded pool, and are reused after their thread exits.
+ * A thread which can not get one drops its messages (also counted).
+ *
+ @param source Prefix printed with the message.  Typically a table name.
+ @param fmt printf() style format.  Must be a string literal.
+ */
+void traceEmit(const char *source, const char *fmt, size_t nargs, const traceArg *args);
+
+inline void traceEmit(const char *source, const char *fmt)
+{
+    traceEmit(source, fmt, 0, 0);
+}
+inline void traceEmit(const char *source, const char *fmt, const traceArg& a)
+{
+    traceEmit(source, fmt, 1, &a);
+}
+inline void traceEmit(const char *source, const char *fmt, const traceArg& a, const traceArg& b)
+{
+    traceArg A[2] = {a, b};
+    traceEmit(source, fmt, 2, A);
+}
+inline void traceEmit(const char *source, const char *fmt, const traceArg& a, const traceArg& b,
+                      const traceArg& c)
+{
+    traceArg A[3] = {a, b, c};
+    traceEmit(source, fmt, 3, A);
+}
+inline void traceEmit(const char *source, const char *fmt, const traceArg& a, const traceArg& b,
+                      const traceArg& c, const traceArg& d)
+{
+    traceArg A[4] = {a, b, c, d};
+    traceEmit(source, fmt, 4, A);
+}
+
+//! Format and print all queued trace messages now.
+void traceFlush();
+
+/** @brief Trace point
+ *
+ * Emits a message if the category CAT at level LVL is enabled for table TBL.
+ * When disabled costs only the test.
+ *
+ @code
+   TBL_TRACE(*this, traceSend, 1, "sent %u bytes", (unsigned)len);
+ @endcode
+ */
+#define TBL_TRACE(TBL, CAT, LVL, ...) \
+    do { if((TBL).traceEnabled(CAT, LVL)) \
+        ::paramTable::traceEmit((TBL).name().c_str(), __VA_ARGS__); } while(0)
+
+} // namespace paramTable
+
+#endif // PARAMTABLETRACE_H
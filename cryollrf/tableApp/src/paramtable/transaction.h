@@ -0,0 +1,198 @@
+#ifndef PARAMTABLETRANSACTION_H
+#define PARAMTABLETRANSACTION_H
+
+#include <vector>
+#include <new>
+
+#include <alarm.h>
+
+#include "scalar.h"
+
+namespace paramTable {
+
+/** @brief Update several parameters of one table as a unit.
+ *
+ * Writes are staged with set() and applied together by commit(),
+ * which gives all of them the same severity and time stamp,
+ * before any listener is notified.  As with value::operator=, a staged
+ * write which does not change a parameter with notifyOnChange()
+ * set is ignored.  Listeners registered with
+ * table::connectChangeset() then receive a single changeset.
+ *
+ @code
+   Guard g(tbl.mutex());
+   transaction T(tbl);
+   T.set(amp, 1.0);
+   T.set(pha, 45.0);
+   T.commit();
+ @endcode
+ *
+ * A transaction which is destroyed without commit() is discarded.
+ *
+ * Staged writes are kept in storage owned by the table and reused,
+ * so scalar writes do not allocate once the table has seen a
+ * transaction of the same size.
+ *
+ @warning The table lock must be held from construction through commit().
+ */
+namespace detail {
+
+// A staged write.  Values no larger than storage are kept in place
+// (scalars, std::string, stride_data), anything else is allocated.
+struct staged_write {
+    union storage {
+        char buf[4*sizeof(void*)];
+        void *ptr;
+        double align_d;
+        epicsUInt64 align_u;
+    };
+    struct ops_t {
+        //! @returns true if the parameter was changed
+        bool (*apply)(valueBase*, const storage&, short sevr, const epicsTime& ts);
+        void (*copy)(storage& dst, const storage& src);
+        void (*destroy)(storage&);
+    };
+
+    template<typename T>
+    static bool apply(valueBase *param, const T& v, short sevr, const epicsTime& ts)
+    {
+        value<T>& p = *static_cast<value<T>*>(param);
+        // as with operator=, unchanged values are not notified
+        if(p.notifyOnChange() && p.severity()==sevr && p.get()==v)
+            return false;
+        return p.update(sample<T>(v, sevr, ts));
+    }
+
+    template<typename T, bool local = sizeof(T)<=sizeof(storage)>
+    struct typed {
+        static const T& get(const storage& s){return *reinterpret_cast<const T*>(s.buf);}
+        static void init(storage& s, const T& v){new (s.buf) T(v);}
+        static void copy(storage& d, const storage& s){new (d.buf) T(get(s));}
+        static void destroy(storage& s){reinterpret_cast<T*>(s.buf)->~T();}
+        static bool apply(valueBase *p, const storage& s, short sevr, const epicsTime& ts)
+        {return staged_write::apply<T>(p, get(s), sevr, ts);}
+        static const ops_t ops;
+    };
+    template<typename T>
+    struct typed<T, false> {
+        static const T& get(const storage& s){return *static_cast<const T*>(s.ptr);}
+        static void init(storage& s, const T& v){s.ptr = new T(v);}
+        static void copy(storage& d, const storage& s){d.ptr = new T(get(s));}
+        static void destroy(storage& s){delete static_cast<T*>(s.ptr);}
+        static bool apply(valueBase *p, const storage& s, short sevr, const epicsTime& ts)
+        {return staged_write::apply<T>(p, get(s), sevr, ts);}
+        static const ops_t ops;
+    };
+
+    valueBase *param;
+    const ops_t *ops; // NULL when empty
+    storage store;
+
+    staged_write() :param(0), ops(0) {}
+    staged_write(const staged_write& o) :param(o.param), ops(0)
+    {
+        if(o.ops)
+            o.ops->copy(store, o.store);
+        ops = o.ops;
+    }
+    staged_write& operator=(const staged_write& o)
+    {
+        if(this!=&o) {
+            clear();
+            param = o.param;
+            if(o.ops)
+                o.ops->copy(store, o.store);
+            ops = o.ops;
+        }
+        return *this;
+    }
+    ~staged_write() {clear();}
+
+    void clear()
+    {
+        if(ops)
+            ops->destroy(store);
+        ops = 0;
+    }
+};
+
+template<typename T, bool local>
+const staged_write::ops_t staged_write::typed<T,local>::ops = {
+    &staged_write::typed<T,local>::apply,
+    &staged_write::typed<T,local>::copy,
+    &staged_write::typed<T,local>::destroy,
+};
+template<typename T>
+const staged_write::ops_t staged_write::typed<T,false>::ops = {
+    &staged_write::typed<T,false>::apply,
+    &staged_write::typed<T,false>::copy,
+    &staged_write::typed<T,false>::destroy,
+};
+
+// Staging storage kept by a table for reuse by successive transactions,
+// so that capacity persists from one transaction to the next.
+struct staging {
+    std::vector<staged_write> writes;
+    bool busy; // in use by a transaction
+    staging() :busy(false) {}
+};
+
+} // namespace detail
+
+class transaction {
+    table& m_table;
+    // the table's staging storage, or m_own if that is already in use
+    std::vector<detail::staged_write> *m_staged;
+    std::vector<detail::staged_write> m_own;
+    short m_severity;
+    epicsTime m_stamp;
+    bool m_stampSet;
+
+    void check(valueBase&);
+
+    transaction(const transaction&);
+    transaction& operator=(const transaction&);
+public:
+    explicit transaction(table& t);
+    ~transaction();
+
+    //! Stage a new value.  The last value staged for a parameter is applied.
+    //! @throws access_error if the parameter is not writable
+    template<typename T, typename U>
+    transaction& set(value<T>& p, const U& v)
+    {
+        typedef detail::staged_write::typed<T> typed_t;
+        check(p);
+        m_staged->push_back(detail::staged_write());
+        detail::staged_write& S = m_staged->back();
+        try {
+            typed_t::init(S.store, T(v));
+        }catch(...){
+            m_staged->pop_back();
+            throw;
+        }
+        S.ops = &typed_t::ops;
+        S.param = &p;
+        return *this;
+    }
+
+    //! Severity given to all staged parameters.  Default NO_ALARM
+    void setSeverity(short s){m_severity=s;}
+    //! Time stamp given to all staged parameters.  Default is the time of commit()
+    void setTimestamp(const epicsTime& t){m_stamp=t; m_stampSet=true;}
+
+    //! Number of staged writes
+    size_t size() const{return m_staged->size();}
+
+    /** Apply all staged writes, then dispatch and notify changeset listeners.
+     *
+     * The transaction is empty afterwards and may be reused.
+     */
+    void commit();
+    //! Discard all staged writes
+    void abort();
+};
+
+} // namespace paramTable
+
+#endif // PARAMTABLETRANSACTION_H
@@ -4,12 +4,14 @@
 #include <string>
 #include <list>
 #include <map>
+#include <vector>
 #include <typeinfo>
 #include <stdexcept>
 #include <ostream>
 
 #include <tr1/memory>
 
+#include <alarm.h>
 #include <epicsMutex.h>
 #include <epicsTime.h>
 
@@ -39,6 +41,16 @@ class table;
 
 class group;
 
+namespace detail {
+// Notification rate limit of a valueBase.  See valueBase::setMaxRate()
+struct throttle {
+    epicsUInt64 interval; // minimum between notifications (ns)
+    epicsUInt64 last;     // epicsMonotonicGet() of the last notification
+    bool deferred;        // in table::m_deferred
+    throttle() :interval(0), last(0), deferred(false) {}
+};
+} // namespace detail
+
 /** @brief Meta-data from a "sample"
  *
  * A sample is a copy of the value meta data.
@@ -55,6 +67,9 @@ struct sampleBase {
     sampleBase() :severity(0), timestamp() {}
     sampleBase(short s, const epicsTime& t) :severity(s), timestamp(t) {}
 
+    //! Test for severity!=INVALID_ALARM
+    bool valid() const{return severity!=INVALID_ALARM;}
+
     void showBase(std::ostream&) const;
 
 protected:
@@ -78,6 +93,7 @@ public:
 protected:
     const std::string m_name;
     table * const m_table;
+    size_t m_index;
 
     short m_severity;
     epicsTime m_stamp;
@@ -86,9 +102,27 @@ protected:
     bool m_changed;
     bool m_onchange;
     bool m_writeable;
+    bool m_restored;
+
+    // next in table change queue.  Only meaningful while m_changed
+    valueBase *m_nextChanged;
 
     signal_t m_baseListeners;
 
+    // groups of which this is a member.  Notified of severity changes
+    std::vector<group*> m_groups;
+    // groups publishing their summary to this.  See group::publishSummary()
+    std::vector<group*> m_summaryOf;
+
+    // NULL unless setMaxRate()
+    detail::throttle *m_throttle;
+
+    // Called by table::dispatch() before dispatch().  True to postpone notification
+    bool holdNotify();
+
+    friend class table;
+    friend class group;
+
     valueBase(const valueBase&);
     valueBase& operator=(const valueBase&);
 
@@ -107,6 +141,8 @@ public:
     //! Full parameter name (DRV.TBL.PARAM)
     std::string fullName() const;
     const std::string& name() const{return m_name;}
+    //! Position in the owning table.  Assigned when added.  See table::param()
+    size_t index() const{return m_index;}
 
     short severity() const{return m_severity;}
     //! Test for severity()!=INVALID_ALARM
@@ -131,6 +167,19 @@ public:
     //! Find current notification behavour.  See setNotifyOnChange()
     bool notifyOnChange() const{return m_onchange;}
 
+    /** Limit the rate at which listeners are notified.
+     *
+     * A change within 1/hz seconds of the previous notification is
+     * held back.  Further changes are coalesced with it, and listeners
+     * are notified once, of the latest value, by a timer when the
+     * interval has elapsed.  The final value is never lost.
+     *
+     * For display-only readbacks of fast tables.  Pass zero to remove.
+     */
+    void setMaxRate(double hz);
+    //! Notification rate limit, or zero
+    double maxRate() const;
+
     //! Access current value timestamp
     const epicsTime& timestamp() const{return m_stamp;}
     //! Set new timestamp.  Must be later then previous timestamp, or ignored
@@ -143,6 +192,10 @@ public:
 
     bool isChanged() const{return m_changed;}
 
+    //! Value came from a warm restart image.  See shmExporter::restore()
+    bool restored() const{return m_restored;}
+    void setRestored(bool v){m_restored=v;}
+
     //! Connect a new un-typed listener
     connection_t connect(const signal_t::callback_type& s){return m_baseListeners.connect(s);}
     //! Remove the given subscription.  The listeners callback will never be invoked
@@ -151,6 +204,9 @@ public:
 
     virtual void show(std::ostream&, int=0) const;
 
+    //! Append all listener subscriptions.  For dispatch cost reports
+    virtual void subscriptions(std::vector<detail::subscription*>&);
+
     //protected: // TODO: Needs to be accessed from table
     /** @brief Do not call directly.  Rather use table::dispatch()
      *
@@ -159,6 +215,18 @@ public:
     virtual void dispatch();
 };
 
+/* Compare type_info instead of dynamic_cast<>.  A parameter
+ * of element type T is always a value<T>.
+ */
+template<typename T>
+value<T>* table::tryFind(const std::string& n) const
+{
+    valueBase* b=tryFindBase(n);
+    if(!b || b->elementType()!=typeid(T))
+        return 0;
+    return static_cast<value<T>*>(b);
+}
+
 } // namespace paramTable
 
 std::ostream& operator<<(std::ostream& strm, const paramTable::valueBase& s);
@@ -0,0 +1,709 @@
+/* Micro-benchmarks of paramTable operations.
+ *
+ * Not part of the IOC.  Run by hand from the build directory
+ *
+ *   ./O.<arch>/paramtableBench [-j results.json]
+ *
+ * With -j, results are also written as JSON for comparison between builds.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <vector>
+#include <string>
+
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <epicsThread.h>
+#include <epicsAtomic.h>
+#include <epicsVersion.h>
+
+#include "paramtable/scalar.h"
+#include "paramtable/group.h"
+#include "paramtable/arraydata.h"
+#include "paramtable/compact.h"
+
+namespace {
+
+using namespace paramTable;
+
+// volatile sink to keep the optimizer from removing the measured work
+volatile epicsUInt32 sink;
+
+struct timer {
+    epicsUInt64 start;
+    timer() :start(epicsMonotonicGet()) {}
+    //! seconds since construction
+    double elapsed() const {return (epicsMonotonicGet()-start)*1e-9;}
+};
+
+struct result {
+    std::string name;
+    double value;
+    const char *unit;
+    size_t count;
+};
+std::vector<result> results;
+
+//! Record a result other than a time per operation
+void record(const char *name, double value, const char *unit, size_t count=0)
+{
+    result R;
+    R.name = name;
+    R.value = value;
+    R.unit = unit;
+    R.count = count;
+    results.push_back(R);
+}
+
+void report(const char *name, double total, size_t count)
+{
+    printf("%-36s %10.3f ms %10.1f ns/op\n", name,
+           total*1e3, total*1e9/double(count));
+    record(name, total*1e9/double(count), "ns/op", count);
+}
+
+void jsonString(FILE *fp, const std::string& s)
+{
+    fputc('"', fp);
+    for(size_t i=0; i<s.size(); i++) {
+        if(s[i]=='"' || s[i]=='\\')
+            fputc('\\', fp);
+        fputc(s[i], fp);
+    }
+    fputc('"', fp);
+}
+
+void writeJSON(const char *fname)
+{
+    FILE *fp = fopen(fname, "w");
+    if(!fp)
+        throw std::runtime_error(std::string("Can't open ")+fname);
+
+    char stamp[64];
+    epicsTime::getCurrent().strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S");
+
+    fprintf(fp, "{\n  \"epics\": \"%s\",\n  \"time\": \"%s\",\n  \"results\": [\n",
+            EPICS_VERSION_STRING, stamp);
+    for(size_t i=0; i<results.size(); i++) {
+        const result& R = results[i];
+        fprintf(fp, "    {\"name\": ");
+        jsonString(fp, R.name);
+        fprintf(fp, ", \"value\": %.6g, \"unit\": \"%s\", \"count\": %lu}%s\n",
+                R.value, R.unit, (unsigned long)R.count,
+                i+1<results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    if(fclose(fp))
+        throw std::runtime_error(std::string("Error writing ")+fname);
+}
+
+// A table with a large number of UInt32 parameters
+class benchTable : public table
+{
+public:
+    std::vector<UInt32*> owned;
+    std::vector<std::string> names;
+
+    benchTable(const std::string& name, size_t nparam)
+        :table(name)
+    {
+        owned.reserve(nparam);
+        names.reserve(nparam);
+        char buf[32];
+        for(size_t i=0; i<nparam; i++) {
+            epicsSnprintf(buf, sizeof(buf), "param%06lu", (unsigned long)i);
+            names.push_back(buf);
+            owned.push_back(new UInt32(*this, buf));
+            *owned.back() = epicsUInt32(i);
+        }
+    }
+    virtual ~benchTable() {
+        for(size_t i=0; i<owned.size(); i++)
+            delete owned[i];
+    }
+};
+
+/* Resolve each parameter once, as device support does for
+ * each record at init.
+ */
+void benchBind(benchTable& T)
+{
+    const size_t N = T.names.size();
+    Guard g(T.mutex());
+
+    {
+        // the previous lookup: ordered map and dynamic_cast<>
+        std::map<std::string, valueBase*> lookup;
+        for(size_t i=0; i<N; i++)
+            lookup[T.names[i]] = &T.param(i);
+
+        timer t;
+        for(size_t i=0; i<N; i++) {
+            UInt32 *p = dynamic_cast<UInt32*>(lookup.find(T.names[i])->second);
+            sink = p->get();
+        }
+        report("bind map+dynamic_cast", t.elapsed(), N);
+    }
+    {
+        timer t;
+        for(size_t i=0; i<N; i++) {
+            UInt32 *p = T.tryFind<epicsUInt32>(T.names[i]);
+            sink = p->get();
+        }
+        report("bind tryFind", t.elapsed(), N);
+    }
+    {
+        timer t;
+        for(size_t i=0; i<N; i++) {
+            handle<epicsUInt32> h(T.resolve<epicsUInt32>(T.names[i]));
+            sink = h->get();
+        }
+        report("bind resolve", t.elapsed(), N);
+    }
+}
+
+// Repeated access to a small working set of parameters
+void benchAccess(benchTable& T)
+{
+    const size_t N = 10000000, M = 64;
+    Guard g(T.mutex());
+
+    std::vector<handle<epicsUInt32> > handles;
+    std::vector<UInt32*> pointers;
+    for(size_t i=0; i<M; i++) {
+        handles.push_back(T.resolve<epicsUInt32>(T.names[i]));
+        pointers.push_back(T.tryFind<epicsUInt32>(T.names[i]));
+    }
+
+    {
+        timer t;
+        epicsUInt32 sum = 0;
+        for(size_t i=0; i<N/100; i++)
+            sum += T.find<epicsUInt32>(T.names[i%M]).get();
+        sink = sum;
+        report("access find by name", t.elapsed(), N/100);
+    }
+    {
+        timer t;
+        epicsUInt32 sum = 0;
+        for(size_t i=0; i<N; i++)
+            sum += handles[i%M]->get();
+        sink = sum;
+        report("access handle", t.elapsed(), N);
+    }
+    {
+        timer t;
+        epicsUInt32 sum = 0;
+        for(size_t i=0; i<N; i++)
+            sum += pointers[i%M]->get();
+        sink = sum;
+        report("access pointer", t.elapsed(), N);
+    }
+}
+
+void noop(const valueBase&) {}
+
+/* Change and dispatch a fixed number of parameters per "pulse",
+ * each with some listeners.  drfm changes ~60 per pulse.
+ */
+void benchDispatch(size_t nlisten)
+{
+    const size_t N = 100000, nchange = 60;
+
+    benchTable T("dispatch", nchange);
+    Guard g(T.mutex());
+
+    for(size_t i=0; i<nchange; i++)
+        for(size_t j=0; j<nlisten; j++)
+            T.owned[i]->connect(&noop);
+    T.dispatch();
+
+    timer t;
+    for(size_t n=0; n<N; n++) {
+        for(size_t i=0; i<nchange; i++)
+            *T.owned[i] = epicsUInt32(n);
+        T.dispatch();
+    }
+    char name[48];
+    epicsSnprintf(name, sizeof(name), "dispatch 60, %lu listen (per pulse)", (unsigned long)nlisten);
+    report(name, t.elapsed(), N);
+
+    timer t2;
+    for(size_t n=0; n<N; n++) {
+        for(size_t i=0; i<nchange; i++)
+            T.owned[i]->markChanged();
+        T.dispatch();
+    }
+    epicsSnprintf(name, sizeof(name), "markChanged 60, %lu listen (pulse)", (unsigned long)nlisten);
+    report(name, t2.elapsed(), N);
+}
+
+/* Assign the same value repeatedly, then dispatch.  With notifyOnChange
+ * only the first is queued.  Otherwise each pass notifies every parameter.
+ */
+void benchAssign(bool onchange)
+{
+    const size_t N = 1000, nparam = 1000;
+
+    benchTable T("assign", nparam);
+    Guard g(T.mutex());
+    for(size_t i=0; i<nparam; i++) {
+        T.owned[i]->setNotifyOnChange(onchange);
+        T.owned[i]->connect(&noop);
+    }
+    T.dispatch();
+
+    timer t;
+    for(size_t n=0; n<N; n++) {
+        for(size_t i=0; i<nparam; i++)
+            *T.owned[i] = 7u;
+        T.dispatch();
+    }
+    report(onchange ? "assign unchanged, notifyOnChange" : "assign unchanged, notify always",
+           t.elapsed(), N*nparam);
+}
+
+class snapTable : public table {
+public:
+    UInt32 scalar;
+    Float64Vector array;
+    snapTable() :table("snapshot"), scalar(*this, "scalar"), array(*this, "array") {
+        scalar = 42u;
+        array = Float64Vector::value_type(1000, 1.0);
+    }
+};
+
+void benchSnapshot()
+{
+    const size_t N = 1000000;
+
+    snapTable T;
+    Guard g(T.mutex());
+    T.dispatch();
+
+    {
+        // volatile to force a read on each iteration
+        UInt32 * volatile scalar = &T.scalar;
+        epicsUInt32 sum = 0;
+        timer t;
+        for(size_t n=0; n<N; n++)
+            sum += scalar->snapshot().value;
+        report("snapshot UInt32", t.elapsed(), N);
+        sink = sum;
+    }
+    {
+        Float64Vector * volatile array = &T.array;
+        size_t sum = 0;
+        timer t;
+        for(size_t n=0; n<N; n++)
+            sum += array->snapshot().value.size();
+        report("snapshot Float64Vector[1000]", t.elapsed(), N);
+        sink = epicsUInt32(sum);
+    }
+}
+
+class groupTable : public table {
+public:
+    group members;
+    std::vector<UInt32*> owned;
+    groupTable(size_t n) :table("group"), members(*this) {
+        char buf[32];
+        for(size_t i=0; i<n; i++) {
+            epicsSnprintf(buf, sizeof(buf), "member%lu", (unsigned long)i);
+            owned.push_back(new UInt32(members, buf));
+            *owned.back() = 0u;
+        }
+    }
+    virtual ~groupTable() {
+        for(size_t i=0; i<owned.size(); i++)
+            delete owned[i];
+    }
+};
+
+// Broadcast to, and query, a group of 60 parameters
+void benchGroup()
+{
+    const size_t N = 100000, nmember = 60;
+
+    groupTable T(nmember);
+    Guard g(T.mutex());
+    T.dispatch();
+
+    {
+        timer t;
+        for(size_t n=0; n<N; n++) {
+            T.members.setSeverity(n&1);
+            T.dispatch();
+        }
+        report("group setSeverity+dispatch (60)", t.elapsed(), N);
+    }
+    {
+        size_t valid = 0;
+        timer t;
+        for(size_t n=0; n<N; n++)
+            valid += T.members.allValid();
+        report("group allValid (60)", t.elapsed(), N);
+        sink = epicsUInt32(valid);
+    }
+}
+
+// Iterate a 1000 element array_data of 10 strides
+void benchArrayIter()
+{
+    const size_t N = 100000, nstride = 10, len = 100;
+
+    array_data<double> A;
+    for(size_t i=0; i<nstride; i++)
+        A.push_back(array_data<double>::stride(len, double(i)));
+    const array_data<double>& CA = A;
+    stride_data<double> S(nstride*len, 1.0);
+
+    {
+        double sum = 0.0;
+        timer t;
+        for(size_t n=0; n<N; n++)
+            for(array_data<double>::const_iterator it=CA.begin(), end=CA.end(); it!=end; ++it)
+                sum += *it;
+        report("array_data iterate (per element)", t.elapsed(), N*nstride*len);
+        sink = epicsUInt32(sum);
+    }
+    {
+        double sum = 0.0;
+        timer t;
+        for(size_t n=0; n<N; n++)
+            for(stride_data<double>::const_iterator it=S.begin(), end=S.end(); it!=end; ++it)
+                sum += *it;
+        report("stride_data iterate (per element)", t.elapsed(), N*nstride*len);
+        sink = epicsUInt32(sum);
+    }
+}
+
+/* Memory per parameter, estimated from the sizes of the containers
+ * (the name is counted at its length as if heap allocated).
+ */
+void benchMemory()
+{
+    const size_t namelen = sizeof("param000000");
+    // name lookup hash node, and bucket
+    const size_t hashnode = sizeof(std::pair<const std::string, void*>) + 2*sizeof(void*);
+
+    size_t full = sizeof(UInt32) + namelen + sizeof(valueBase*) + hashnode;
+    size_t hot = sizeof(epicsUInt32) + sizeof(short) + sizeof(epicsTime);
+    size_t compact = hot + sizeof(std::string) + namelen + hashnode;
+
+    printf("%-36s %10lu bytes/param\n", "memory value<UInt32>", (unsigned long)full);
+    printf("%-36s %10lu bytes/param (%lu hot)\n", "memory compact_params<UInt32>",
+           (unsigned long)compact, (unsigned long)hot);
+    record("memory value<UInt32>", double(full), "bytes/param");
+    record("memory compact_params<UInt32>", double(compact), "bytes/param");
+    record("memory compact_params<UInt32> hot", double(hot), "bytes/param");
+}
+
+// A table with one compact_params of UInt32
+class compactTable : public table
+{
+public:
+    compact_params<epicsUInt32> values;
+
+    compactTable(const std::string& name, size_t nparam)
+        :table(name)
+        ,values(*this, "values")
+    {
+        values.reserve(nparam);
+        char buf[32];
+        for(size_t i=0; i<nparam; i++) {
+            epicsSnprintf(buf, sizeof(buf), "param%06lu", (unsigned long)i);
+            values.add(buf);
+        }
+    }
+};
+
+/* Update all of a large number of parameters, then dispatch.
+ * As an aggregator would on each pass.
+ */
+void benchBulk()
+{
+    const size_t nparam = 50000, N = 200;
+    std::vector<epicsUInt32> buf(nparam);
+
+    {
+        benchTable T("bulk", nparam);
+        Guard g(T.mutex());
+        T.dispatch();
+
+        timer t;
+        for(size_t n=0; n<N; n++) {
+            for(size_t i=0; i<nparam; i++)
+                *T.owned[i] = epicsUInt32(n+i);
+            T.dispatch();
+        }
+        report("bulk update value<UInt32> (per param)", t.elapsed(), N*nparam);
+    }
+    {
+        compactTable T("bulkcompact", nparam);
+        Guard g(T.mutex());
+        T.dispatch();
+
+        timer t;
+        for(size_t n=0; n<N; n++) {
+            for(size_t i=0; i<nparam; i++)
+                buf[i] = epicsUInt32(n+i);
+            T.values.assign(0, &buf[0], nparam, epicsTime::getCurrent());
+            T.dispatch();
+        }
+        report("bulk update compact (per param)", t.elapsed(), N*nparam);
+    }
+}
+
+struct counter {
+    size_t n;
+    counter() :n(0) {}
+    void hit() {n++;}
+};
+
+// Invoke a listener list with a number of bound member function listeners
+void benchFanout(size_t nlisten)
+{
+    const size_t N = 10000000/nlisten;
+
+    counter C;
+    callback_list<valueBase> L;
+    for(size_t i=0; i<nlisten; i++)
+        L.connect(std::tr1::bind(&counter::hit, &C));
+
+    benchTable T("fanout", 1);
+
+    timer t;
+    for(size_t n=0; n<N; n++)
+        L(*T.owned[0]);
+
+    char name[40];
+    epicsSnprintf(name, sizeof(name), "fan-out to %lu (per call)", (unsigned long)nlisten);
+    report(name, t.elapsed(), N);
+    sink = epicsUInt32(C.n);
+}
+
+void benchConnect()
+{
+    const size_t N = 1000000, M = 16;
+
+    counter C;
+    callback_list<valueBase> L;
+    std::vector<subscription_type> subs(M);
+
+    timer t;
+    for(size_t n=0; n<N; n+=M) {
+        for(size_t i=0; i<M; i++)
+            subs[i] = L.connect(std::tr1::bind(&counter::hit, &C));
+        for(size_t i=0; i<M; i++)
+            subs[i]->disconnect();
+    }
+    report("connect+disconnect", t.elapsed(), N);
+}
+
+/* Synthetic load of 6 cavities.  Each has a table of 60 scalars and
+ * 4 arrays of 1000 elements updated as fast as possible by an I/O thread,
+ * while 4 "scan" threads read every parameter, either locking
+ * the table for snapshot() (as device support did) or with published().
+ */
+class cavityTable : public table, public epicsThreadRunable
+{
+public:
+    std::vector<Float64*> scalars;
+    std::vector<Float64Vector*> arrays;
+    int *stop;
+    size_t pulses;
+    epicsThread worker;
+
+    cavityTable(const std::string& name, int *stop)
+        :table(name)
+        ,stop(stop)
+        ,pulses(0)
+        ,worker(*this, name.c_str(), epicsThreadGetStackSize(epicsThreadStackSmall), epicsThreadPriorityHigh)
+    {
+        char buf[32];
+        for(size_t i=0; i<60; i++) {
+            epicsSnprintf(buf, sizeof(buf), "scalar%02lu", (unsigned long)i);
+            scalars.push_back(new Float64(*this, buf));
+        }
+        for(size_t i=0; i<4; i++) {
+            epicsSnprintf(buf, sizeof(buf), "array%lu", (unsigned long)i);
+            arrays.push_back(new Float64Vector(*this, buf));
+        }
+    }
+    virtual ~cavityTable() {
+        for(size_t i=0; i<scalars.size(); i++)
+            delete scalars[i];
+        for(size_t i=0; i<arrays.size(); i++)
+            delete arrays[i];
+    }
+
+    virtual void run()
+    {
+        while(!epicsAtomicGetIntT(stop)) {
+            Guard g(mutex());
+            double v = double(pulses);
+            for(size_t i=0; i<scalars.size(); i++)
+                *scalars[i] = v;
+            for(size_t i=0; i<arrays.size(); i++) {
+                Float64Vector::value_type& A = arrays[i]->get();
+                A.resize(1000);
+                std::fill(A.begin(), A.end(), v);
+                arrays[i]->markChanged();
+            }
+            dispatch();
+            pulses++;
+        }
+    }
+};
+
+struct scanThread : public epicsThreadRunable {
+    std::vector<cavityTable*>& cavs;
+    bool lockfree;
+    int *stop;
+    size_t reads;
+    std::vector<double> buf;
+    epicsThread worker;
+
+    scanThread(std::vector<cavityTable*>& cavs, bool lockfree, int *stop)
+        :cavs(cavs), lockfree(lockfree), stop(stop), reads(0), buf(1000)
+        ,worker(*this, "scan", epicsThreadGetStackSize(epicsThreadStackSmall), epicsThreadPriorityScanHigh)
+    {}
+    virtual ~scanThread() {}
+
+    template<typename T>
+    sample<T> read(table& tbl, value<T>& p)
+    {
+        if(lockfree)
+            return p.published();
+        Guard g(tbl.mutex());
+        return p.snapshot();
+    }
+
+    virtual void run()
+    {
+        while(!epicsAtomicGetIntT(stop)) {
+            for(size_t c=0; c<cavs.size(); c++) {
+                cavityTable& C = *cavs[c];
+                for(size_t i=0; i<C.scalars.size(); i++)
+                    buf[0] = read(C, *C.scalars[i]).value;
+                for(size_t i=0; i<C.arrays.size(); i++) {
+                    Float64::value_type *dest = &buf[0];
+                    sample<Float64Vector::value_type> S(read(C, *C.arrays[i]));
+                    std::copy(S.value.begin(), S.value.begin()+std::min(S.value.size(), buf.size()), dest);
+                }
+                reads += C.scalars.size()+C.arrays.size();
+            }
+        }
+    }
+};
+
+void benchContention(bool lockfree)
+{
+    const double duration = 2.0;
+    int stop = 0;
+
+    std::vector<cavityTable*> cavs;
+    std::vector<scanThread*> scans;
+    for(size_t i=0; i<6; i++) {
+        char name[16];
+        epicsSnprintf(name, sizeof(name), "cav%lu", (unsigned long)i);
+        cavs.push_back(new cavityTable(name, &stop));
+    }
+    for(size_t i=0; i<4; i++)
+        scans.push_back(new scanThread(cavs, lockfree, &stop));
+
+    for(size_t i=0; i<cavs.size(); i++)
+        cavs[i]->worker.start();
+    for(size_t i=0; i<scans.size(); i++)
+        scans[i]->worker.start();
+
+    epicsThreadSleep(duration);
+    epicsAtomicSetIntT(&stop, 1);
+
+    size_t pulses = 0, reads = 0;
+    for(size_t i=0; i<scans.size(); i++) {
+        scans[i]->worker.exitWait();
+        reads += scans[i]->reads;
+        delete scans[i];
+    }
+    for(size_t i=0; i<cavs.size(); i++) {
+        cavs[i]->worker.exitWait();
+        pulses += cavs[i]->pulses;
+        delete cavs[i];
+    }
+
+    const char *name = lockfree ? "6 cavity load, published()" : "6 cavity load, lock+snapshot()";
+    printf("%-36s %10.0f pulse/s %10.0f read/s\n", name,
+           pulses/duration, reads/duration);
+    std::string rname(name);
+    record((rname+" pulses").c_str(), pulses/duration, "1/s", pulses);
+    record((rname+" reads").c_str(), reads/duration, "1/s", reads);
+}
+
+} // namespace
+
+void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-j results.json]\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *json = 0;
+    for(int i=1; i<argc; i++) {
+        if(strcmp(argv[i], "-j")==0 && i+1<argc) {
+            json = argv[++i];
+        } else {
+            usage(argv[0]);
+            return strcmp(argv[i], "-h")==0 ? 0 : 1;
+        }
+    }
+
+    try {
+        table::tableOnce();
+
+        size_t nparam = 100000;
+        {
+            timer t;
+            benchTable T("bench", nparam);
+            report("create", t.elapsed(), nparam);
+
+            benchBind(T);
+            benchAccess(T);
+        }
+
+        benchAssign(true);
+        benchAssign(false);
+
+        benchDispatch(0);
+        benchDispatch(1);
+        benchDispatch(8);
+
+        benchSnapshot();
+        benchGroup();
+        benchArrayIter();
+
+        benchMemory();
+        benchBulk();
+
+        benchConnect();
+        benchFanout(1);
+        benchFanout(4);
+        benchFanout(64);
+
+        benchContention(false);
+        benchContention(true);
+
+        if(json)
+            writeJSON(json);
+
+        return 0;
+    }catch(std::exception& e){
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,455 @@
+/* Scaling benchmark of threads sharing paramTable tables.
+ *
+ * Not part of the IOC.  Run by hand from the build directory
+ *
+ *   ./O.<arch>/paramtableContention [options]
+ *
+ * Models the threads of an IOC which use a table:
+ *  - dispatchers, like the drfm reactor, which lock a table, update
+ *    many parameters, then dispatch()
+ *  - writers, like CA puts in write_val(), which lock a table, update
+ *    one parameter, then dispatch()
+ *  - readers, like I/O Intr scans in read_val(), which read one parameter
+ *    with published(), or with -L under the table lock
+ *
+ * For each kind of thread, reports throughput, time spent waiting for
+ * the table lock, and the distribution of the time for each operation.
+ * With -x, repeats with 2x, 4x, ... threads of each kind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsAtomic.h>
+#include <epicsVersion.h>
+
+#include "paramtable/scalar.h"
+
+namespace {
+
+using namespace paramTable;
+
+/* Log-linear histogram of durations in nanoseconds.
+ * 8 buckets per power of two, so percentiles are within 12.5%
+ */
+struct histogram {
+    enum {sub=8, nbuckets=64*sub};
+    epicsUInt64 counts[nbuckets];
+    epicsUInt64 total, sum, max;
+
+    histogram() {clear();}
+
+    void clear()
+    {
+        memset(counts, 0, sizeof(counts));
+        total = sum = max = 0;
+    }
+
+    static size_t bucket(epicsUInt64 ns)
+    {
+        if(ns<sub)
+            return size_t(ns);
+        unsigned e=0;
+        for(epicsUInt64 v=ns; v>1; v>>=1)
+            e++;
+        size_t mant = size_t(ns>>(e-3))&(sub-1);
+        return (e-2)*sub + mant;
+    }
+
+    // smallest duration which falls in bucket i
+    static epicsUInt64 lower(size_t i)
+    {
+        if(i<sub)
+            return i;
+        unsigned e = unsigned(i/sub)+2;
+        return (epicsUInt64(sub) + (i%sub))<<(e-3);
+    }
+
+    void add(epicsUInt64 ns)
+    {
+        counts[bucket(ns)]++;
+        total++;
+        sum += ns;
+        if(ns>max)
+            max = ns;
+    }
+
+    void merge(const histogram& o)
+    {
+        for(size_t i=0; i<nbuckets; i++)
+            counts[i] += o.counts[i];
+        total += o.total;
+        sum += o.sum;
+        if(o.max>max)
+            max = o.max;
+    }
+
+    double mean() const{return total ? double(sum)/total : 0.0;}
+
+    //! Upper bound of the p-th percentile (0<p<=1)
+    double percentile(double p) const
+    {
+        if(!total)
+            return 0.0;
+        epicsUInt64 goal = epicsUInt64(p*total + 0.5), seen = 0;
+        if(goal==0)
+            goal = 1;
+        for(size_t i=0; i<nbuckets; i++) {
+            seen += counts[i];
+            if(seen>=goal)
+                return double(std::min(lower(i+1), max));
+        }
+        return double(max);
+    }
+};
+
+void noop(const valueBase&) {}
+
+class contTable : public table
+{
+public:
+    std::vector<UInt32*> params;
+
+    contTable(const std::string& name, size_t nparam)
+        :table(name)
+    {
+        char buf[32];
+        for(size_t i=0; i<nparam; i++) {
+            epicsSnprintf(buf, sizeof(buf), "param%lu", (unsigned long)i);
+            params.push_back(new UInt32(*this, buf));
+            params.back()->connect(&noop);
+        }
+        Guard g(mutex());
+        for(size_t i=0; i<nparam; i++)
+            *params[i] = 0u;
+        dispatch();
+    }
+    virtual ~contTable()
+    {
+        for(size_t i=0; i<params.size(); i++)
+            delete params[i];
+    }
+};
+
+struct config {
+    size_t ntables, nparams, nwriters, nreaders, ndispatchers;
+    size_t pulse; // parameters changed by each dispatcher pass
+    double duration;
+    bool readLocked;
+};
+
+enum role_t {dispatcher, writer, reader};
+const char * const roleNames[] = {"dispatcher", "writer", "reader"};
+
+struct worker : public epicsThreadRunable
+{
+    const config& conf;
+    std::vector<contTable*>& tables;
+    role_t role;
+    size_t id;
+    int *stop;
+    epicsEvent& go;
+
+    epicsUInt32 seed; // per thread pseudo random sequence
+    size_t ops;
+    histogram wait, latency;
+
+    epicsThread thread;
+
+    worker(const config& conf, std::vector<contTable*>& tables, role_t role, size_t id,
+           int *stop, epicsEvent& go)
+        :conf(conf), tables(tables), role(role), id(id), stop(stop), go(go)
+        ,seed(epicsUInt32(id*2654435761u+1u)), ops(0)
+        ,thread(*this, roleNames[role],
+                epicsThreadGetStackSize(epicsThreadStackSmall),
+                role==dispatcher ? epicsThreadPriorityHigh : epicsThreadPriorityMedium)
+    {}
+    virtual ~worker() {}
+
+    size_t next(size_t n)
+    {
+        seed = seed*1664525u + 1013904223u;
+        return (seed>>8)%n;
+    }
+
+    void dispatchOne(size_t n)
+    {
+        contTable& T = *tables[(id + n*conf.ndispatchers)%tables.size()];
+        epicsUInt64 start = epicsMonotonicGet();
+        Guard g(T.mutex());
+        epicsUInt64 locked = epicsMonotonicGet();
+        epicsTime now(epicsTime::getCurrent());
+        size_t first = next(T.params.size());
+        for(size_t i=0; i<conf.pulse; i++) {
+            UInt32& P = *T.params[(first+i)%T.params.size()];
+            P = epicsUInt32(n);
+            P.setTimestamp(now);
+        }
+        T.dispatch();
+        wait.add(locked-start);
+        latency.add(epicsMonotonicGet()-start);
+    }
+
+    void writeOne(size_t n)
+    {
+        contTable& T = *tables[next(tables.size())];
+        UInt32& P = *T.params[next(T.params.size())];
+        epicsUInt64 start = epicsMonotonicGet();
+        Guard g(T.mutex());
+        epicsUInt64 locked = epicsMonotonicGet();
+        P.update(sample<epicsUInt32>(epicsUInt32(n), 0, epicsTime::getCurrent()));
+        T.dispatch();
+        wait.add(locked-start);
+        latency.add(epicsMonotonicGet()-start);
+    }
+
+    void readOne()
+    {
+        contTable& T = *tables[next(tables.size())];
+        UInt32& P = *T.params[next(T.params.size())];
+        epicsUInt64 start = epicsMonotonicGet();
+        sample<epicsUInt32> S;
+        if(conf.readLocked) {
+            Guard g(T.mutex());
+            wait.add(epicsMonotonicGet()-start);
+            S = P.snapshot();
+        } else {
+            S = P.published();
+        }
+        latency.add(epicsMonotonicGet()-start);
+        seed += S.value; // keep the read
+    }
+
+    virtual void run()
+    {
+        go.wait();
+        go.signal(); // wake the next
+        while(!epicsAtomicGetIntT(stop)) {
+            switch(role) {
+            case dispatcher: dispatchOne(ops); break;
+            case writer:     writeOne(ops); break;
+            case reader:     readOne(); break;
+            }
+            ops++;
+        }
+    }
+};
+
+struct roleResult {
+    size_t threads, ops;
+    histogram wait, latency;
+    roleResult() :threads(0), ops(0) {}
+};
+
+struct runResult {
+    size_t scale;
+    double duration;
+    roleResult roles[3];
+};
+
+runResult runOnce(const config& conf, size_t scale)
+{
+    int stop = 0;
+    epicsEvent go;
+
+    std::vector<contTable*> tables;
+    std::vector<worker*> workers;
+
+    runResult ret;
+    ret.scale = scale;
+    ret.duration = conf.duration;
+
+    try {
+        for(size_t i=0; i<conf.ntables; i++) {
+            char name[16];
+            epicsSnprintf(name, sizeof(name), "cont%lu", (unsigned long)i);
+            tables.push_back(new contTable(name, conf.nparams));
+        }
+
+        const size_t counts[3] = {conf.ndispatchers*scale, conf.nwriters*scale, conf.nreaders*scale};
+        for(int r=0; r<3; r++) {
+            for(size_t i=0; i<counts[r]; i++) {
+                workers.push_back(new worker(conf, tables, role_t(r), i, &stop, go));
+                workers.back()->thread.start();
+            }
+        }
+
+        go.signal();
+        epicsThreadSleep(conf.duration);
+        epicsAtomicSetIntT(&stop, 1);
+
+        for(size_t i=0; i<workers.size(); i++) {
+            worker& W = *workers[i];
+            W.thread.exitWait();
+            roleResult& R = ret.roles[W.role];
+            R.threads++;
+            R.ops += W.ops;
+            R.wait.merge(W.wait);
+            R.latency.merge(W.latency);
+        }
+    }catch(...){
+        epicsAtomicSetIntT(&stop, 1);
+        go.signal();
+        for(size_t i=0; i<workers.size(); i++)
+            delete workers[i];
+        for(size_t i=0; i<tables.size(); i++)
+            delete tables[i];
+        throw;
+    }
+    for(size_t i=0; i<workers.size(); i++)
+        delete workers[i];
+    for(size_t i=0; i<tables.size(); i++)
+        delete tables[i];
+    return ret;
+}
+
+void printRun(const runResult& run)
+{
+    printf("scale x%lu\n", (unsigned long)run.scale);
+    printf("  %-10s %7s %12s %10s %10s %10s %10s %10s\n", "role", "threads", "ops/s",
+           "wait avg", "wait p99", "op p50", "op p99", "op p99.9");
+    for(int r=0; r<3; r++) {
+        const roleResult& R = run.roles[r];
+        if(!R.threads)
+            continue;
+        printf("  %-10s %7lu %12.0f %8.0fns %8.0fns %8.0fns %8.0fns %8.0fns\n",
+               roleNames[r], (unsigned long)R.threads, R.ops/run.duration,
+               R.wait.mean(), R.wait.percentile(0.99),
+               R.latency.percentile(0.5), R.latency.percentile(0.99),
+               R.latency.percentile(0.999));
+    }
+}
+
+void writeJSON(const char *fname, const config& conf, const std::vector<runResult>& runs)
+{
+    FILE *fp = fopen(fname, "w");
+    if(!fp)
+        throw std::runtime_error(std::string("Can't open ")+fname);
+
+    fprintf(fp, "{\n  \"epics\": \"%s\",\n", EPICS_VERSION_STRING);
+    fprintf(fp, "  \"tables\": %lu, \"params\": %lu, \"pulse\": %lu, \"readLocked\": %s,\n",
+            (unsigned long)conf.ntables, (unsigned long)conf.nparams,
+            (unsigned long)conf.pulse, conf.readLocked ? "true" : "false");
+    fprintf(fp, "  \"runs\": [\n");
+    for(size_t n=0; n<runs.size(); n++) {
+        const runResult& run = runs[n];
+        fprintf(fp, "    {\"scale\": %lu, \"duration\": %g, \"roles\": {",
+                (unsigned long)run.scale, run.duration);
+        bool first = true;
+        for(int r=0; r<3; r++) {
+            const roleResult& R = run.roles[r];
+            if(!R.threads)
+                continue;
+            fprintf(fp, "%s\n      \"%s\": {\"threads\": %lu, \"ops_per_sec\": %.6g,"
+                        " \"wait_ns\": {\"mean\": %.6g, \"p99\": %.6g, \"max\": %.6g},"
+                        " \"op_ns\": {\"p50\": %.6g, \"p99\": %.6g, \"p999\": %.6g, \"max\": %.6g}}",
+                    first ? "" : ",", roleNames[r],
+                    (unsigned long)R.threads, R.ops/run.duration,
+                    R.wait.mean(), R.wait.percentile(0.99), double(R.wait.max),
+                    R.latency.percentile(0.5), R.latency.percentile(0.99),
+                    R.latency.percentile(0.999), double(R.latency.max));
+            first = false;
+        }
+        fprintf(fp, "\n    }}%s\n", n+1<runs.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    if(fclose(fp))
+        throw std::runtime_error(std::string("Error writing ")+fname);
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -t <n>   Number of tables (4)\n"
+            "  -p <n>   Parameters per table (200)\n"
+            "  -d <n>   Dispatcher threads (2)\n"
+            "  -w <n>   Writer threads (2)\n"
+            "  -r <n>   Reader threads (4)\n"
+            "  -u <n>   Parameters changed per dispatcher pass (60)\n"
+            "  -s <sec> Duration of each run (2)\n"
+            "  -L       Readers lock the table and snapshot() instead of published()\n"
+            "  -x <n>   Repeat with 2x, 4x, ... up to n times as many threads\n"
+            "  -j <file> Also write results as JSON\n",
+            argv0);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    config conf;
+    conf.ntables = 4;
+    conf.nparams = 200;
+    conf.ndispatchers = 2;
+    conf.nwriters = 2;
+    conf.nreaders = 4;
+    conf.pulse = 60;
+    conf.duration = 2.0;
+    conf.readLocked = false;
+    size_t maxscale = 1;
+    const char *json = 0;
+
+    for(int i=1; i<argc; i++) {
+        const char *arg = argv[i];
+        if(strcmp(arg, "-L")==0) {
+            conf.readLocked = true;
+            continue;
+        } else if(strcmp(arg, "-h")==0) {
+            usage(argv[0]);
+            return 0;
+        } else if(arg[0]!='-' || strlen(arg)!=2 || i+1>=argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *val = argv[++i];
+        switch(arg[1]) {
+        case 't': conf.ntables = strtoul(val, 0, 0); break;
+        case 'p': conf.nparams = strtoul(val, 0, 0); break;
+        case 'd': conf.ndispatchers = strtoul(val, 0, 0); break;
+        case 'w': conf.nwriters = strtoul(val, 0, 0); break;
+        case 'r': conf.nreaders = strtoul(val, 0, 0); break;
+        case 'u': conf.pulse = strtoul(val, 0, 0); break;
+        case 's': conf.duration = atof(val); break;
+        case 'x': maxscale = strtoul(val, 0, 0); break;
+        case 'j': json = val; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(conf.ntables==0 || conf.nparams==0 || conf.duration<=0.0 || maxscale==0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if(conf.pulse>conf.nparams)
+        conf.pulse = conf.nparams;
+
+    try {
+        table::tableOnce();
+
+        std::vector<runResult> runs;
+        for(size_t scale=1; scale<=maxscale; scale*=2) {
+            runs.push_back(runOnce(conf, scale));
+            printRun(runs.back());
+        }
+
+        if(json)
+            writeJSON(json, conf, runs);
+
+        return 0;
+    }catch(std::exception& e){
+        fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,335 @@
+
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <epicsAtomic.h>
+#include <epicsTime.h>
+
+#include "paramtable/shmexport.h"
+#include "paramtable/scalar.h"
+#include "tblshm.h"
+
+namespace paramTable {
+
+namespace {
+
+template<typename T>
+struct scalarOps {
+    static size_t length(const valueBase&) {return 1u;}
+    static size_t copy(valueBase& p, void *dst, size_t)
+    {
+        T v = static_cast<value<T>&>(p).get();
+        memcpy(dst, &v, sizeof(v));
+        return 1u;
+    }
+    static void restore(valueBase& p, const void *src, size_t, const sampleBase& meta)
+    {
+        sample<T> S(T(), meta.severity, meta.timestamp);
+        memcpy(&S.value, src, sizeof(S.value));
+        static_cast<value<T>&>(p).update(S);
+    }
+};
+
+template<typename E>
+struct arrayOps {
+    typedef value<stride_data<E> > param_type;
+    static size_t length(const valueBase& p)
+    {
+        return static_cast<const param_type&>(p).get().size();
+    }
+    static size_t copy(valueBase& p, void *dst, size_t capacity)
+    {
+        const stride_data<E>& A = static_cast<const param_type&>(p).get();
+        size_t n = std::min(A.size(), capacity);
+        std::copy(A.begin(), A.begin()+n, static_cast<E*>(dst));
+        return n;
+    }
+    static void restore(valueBase& p, const void *src, size_t count, const sampleBase& meta)
+    {
+        const E *S = static_cast<const E*>(src);
+        sample<stride_data<E> > V(stride_data<E>(count), meta.severity, meta.timestamp);
+        std::copy(S, S+count, V.value.begin());
+        static_cast<param_type&>(p).update(V);
+    }
+};
+
+struct typeOps {
+    const std::type_info *info;
+    unsigned type;
+    size_t elemSize;
+    size_t (*length)(const valueBase&);
+    size_t (*copy)(valueBase&, void*, size_t);
+    void (*restore)(valueBase&, const void*, size_t, const sampleBase&);
+};
+
+#define SCALAR(T, C) {&typeid(T), C, sizeof(T), &scalarOps<T>::length, &scalarOps<T>::copy, &scalarOps<T>::restore}
+#define ARRAY(E, C) {&typeid(stride_data<E>), C, sizeof(E), &arrayOps<E>::length, &arrayOps<E>::copy, &arrayOps<E>::restore}
+const typeOps types[] = {
+    SCALAR(epicsUInt32, tblshmUInt32),
+    SCALAR(epicsInt32, tblshmInt32),
+    SCALAR(epicsFloat64, tblshmFloat64),
+    ARRAY(epicsUInt8, tblshmUInt8Array),
+    ARRAY(epicsInt8, tblshmInt8Array),
+    ARRAY(epicsUInt16, tblshmUInt16Array),
+    ARRAY(epicsInt16, tblshmInt16Array),
+    ARRAY(epicsUInt32, tblshmUInt32Array),
+    ARRAY(epicsInt32, tblshmInt32Array),
+    ARRAY(epicsFloat32, tblshmFloat32Array),
+    ARRAY(epicsFloat64, tblshmFloat64Array),
+};
+#undef SCALAR
+#undef ARRAY
+
+const typeOps* findType(const valueBase& p)
+{
+    const std::type_info& T = p.elementType();
+    for(size_t i=0; i<sizeof(types)/sizeof(types[0]); i++) {
+        if(*types[i].info==T)
+            return &types[i];
+    }
+    return 0;
+}
+
+size_t align(size_t n)
+{
+    return (n+63u)&~size_t(63u);
+}
+
+} // namespace
+
+shmExporter::shmExporter(table& t, const std::string& shmname, bool persist)
+    :m_table(t)
+    ,m_name(shmname)
+    ,m_persist(persist)
+    ,m_entries()
+    ,m_byIndex()
+    ,m_base(0)
+    ,m_size(0)
+    ,m_conn(0)
+{}
+
+shmExporter::~shmExporter()
+{
+    if(m_conn) {
+        Guard g(m_table.mutex());
+        m_table.disconnect(m_conn);
+    }
+    if(m_base) {
+        munmap(m_base, m_size);
+        if(!m_persist)
+            shm_unlink(m_name.c_str());
+    }
+}
+
+bool shmExporter::supported(const valueBase& p)
+{
+    return findType(p)!=0;
+}
+
+void shmExporter::add(const std::string& pname, size_t capacity)
+{
+    if(m_base)
+        throw std::logic_error(m_name+": add() after start()");
+
+    valueBase& p = m_table.findBase(pname);
+    const typeOps *ops = findType(p);
+    if(!ops)
+        throw std::runtime_error(pname+": type can not be exported");
+    if(p.name().size()>=sizeof(((tblshm_param*)0)->name))
+        throw std::runtime_error(pname+": name too long to export");
+
+    if(ops->type<tblshmUInt8Array)
+        capacity = 1u;
+    else if(capacity==0)
+        capacity = std::max(ops->length(p), size_t(1u));
+
+    entry E;
+    E.param = &p;
+    E.type = ops->type;
+    E.elemSize = ops->elemSize;
+    E.capacity = capacity;
+    E.copy = ops->copy;
+    E.restore = ops->restore;
+    E.shared = 0;
+    m_entries.push_back(E);
+}
+
+size_t shmExporter::restore()
+{
+    if(m_base)
+        throw std::logic_error(m_name+": restore() after start()");
+
+    int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+    if(fd<0) {
+        if(errno==ENOENT)
+            return 0; // first run
+        throw std::runtime_error(m_name+": shm_open: "+strerror(errno));
+    }
+    struct stat info;
+    if(fstat(fd, &info)!=0 || size_t(info.st_size)<sizeof(tblshm_header)) {
+        close(fd);
+        return 0;
+    }
+    void *base = mmap(0, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base==MAP_FAILED)
+        throw std::runtime_error(m_name+": mmap: "+strerror(errno));
+
+    const char *B = static_cast<const char*>(base);
+    const size_t size = info.st_size;
+    const tblshm_header *H = reinterpret_cast<const tblshm_header*>(B);
+
+    size_t restored = 0;
+    // ignore a segment from an incompatible version, or one never completed
+    if(H->magic==TBLSHM_MAGIC && H->version==TBLSHM_VERSION
+            && H->param_size==sizeof(tblshm_param)
+            && H->total_size<=size
+            && sizeof(tblshm_header)+H->nparams*sizeof(tblshm_param)<=size)
+    {
+        const tblshm_param *P = reinterpret_cast<const tblshm_param*>(B+sizeof(tblshm_header));
+
+        for(size_t i=0; i<m_entries.size(); i++) {
+            entry& E = m_entries[i];
+            if(!E.param->writable())
+                continue;
+
+            for(size_t j=0; j<H->nparams; j++) {
+                const tblshm_param& S = P[j];
+                if(strncmp(S.name, E.param->name().c_str(), sizeof(S.name))!=0)
+                    continue;
+
+                // an odd sequence means the previous run stopped during an update
+                if(S.type!=E.type || S.elem_size!=E.elemSize || (S.seq&1u)
+                        || S.slot>1u || S.count>S.capacity
+                        || S.offset[S.slot]+size_t(S.count)*S.elem_size>size)
+                    break;
+
+                epicsTimeStamp stamp;
+                stamp.secPastEpoch = S.sec;
+                stamp.nsec = S.nsec;
+                sampleBase meta(S.severity, stamp);
+
+                size_t count = std::min(size_t(S.count), E.capacity);
+                if(E.type<tblshmUInt8Array && count!=1u)
+                    break;
+
+                E.restore(*E.param, B+S.offset[S.slot], count, meta);
+                E.param->setRestored(true);
+                restored++;
+                break;
+            }
+        }
+    }
+
+    munmap(base, size);
+    return restored;
+}
+
+void shmExporter::start()
+{
+    if(m_base)
+        throw std::logic_error(m_name+": already started");
+
+    // layout
+    size_t size = align(sizeof(tblshm_header) + m_entries.size()*sizeof(tblshm_param));
+    std::vector<size_t> offsets(m_entries.size());
+    for(size_t i=0; i<m_entries.size(); i++) {
+        offsets[i] = size;
+        size += 2u*align(m_entries[i].capacity*m_entries[i].elemSize);
+    }
+
+    // replace any segment left by a previous run.  Existing readers keep the old one.
+    // Its content has already been consumed by restore() if wanted.
+    shm_unlink(m_name.c_str());
+    int fd = shm_open(m_name.c_str(), O_RDWR|O_CREAT|O_EXCL, 0644);
+    if(fd<0)
+        throw std::runtime_error(m_name+": shm_open: "+strerror(errno));
+    if(ftruncate(fd, size)!=0) {
+        int err = errno;
+        close(fd);
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error(m_name+": ftruncate: "+strerror(err));
+    }
+    void *base = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base==MAP_FAILED) {
+        int err = errno;
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error(m_name+": mmap: "+strerror(err));
+    }
+    m_base = static_cast<char*>(base);
+    m_size = size;
+
+    // ftruncate() zero fills
+    tblshm_header *H = reinterpret_cast<tblshm_header*>(m_base);
+    H->version = TBLSHM_VERSION;
+    H->nparams = m_entries.size();
+    H->param_size = sizeof(tblshm_param);
+    H->total_size = size;
+    epicsTimeStamp now = epicsTime::getCurrent();
+    H->generation = (epicsUInt64(now.secPastEpoch)<<32) | now.nsec;
+    strncpy(H->table, m_table.name().c_str(), sizeof(H->table)-1);
+
+    m_byIndex.assign(m_table.paramCount(), -1);
+    tblshm_param *P = reinterpret_cast<tblshm_param*>(m_base+sizeof(tblshm_header));
+    for(size_t i=0; i<m_entries.size(); i++) {
+        entry& E = m_entries[i];
+        E.shared = &P[i];
+        strncpy(P[i].name, E.param->name().c_str(), sizeof(P[i].name)-1);
+        P[i].type = E.type;
+        P[i].elem_size = E.elemSize;
+        P[i].capacity = E.capacity;
+        P[i].offset[0] = offsets[i];
+        P[i].offset[1] = offsets[i] + align(E.capacity*E.elemSize);
+        m_byIndex[E.param->index()] = int(i);
+        update(E);
+    }
+
+    // readers check the magic last
+    epicsAtomicWriteMemoryBarrier();
+    H->magic = TBLSHM_MAGIC;
+
+    m_conn = m_table.connectChangeset(std::tr1::bind(&shmExporter::changed, this, std::tr1::placeholders::_1));
+}
+
+void shmExporter::changed(const changeset& C)
+{
+    for(size_t n=0; n<C.indices.size(); n++) {
+        size_t i = C.indices[n];
+        if(i<m_byIndex.size() && m_byIndex[i]>=0)
+            update(m_entries[m_byIndex[i]]);
+    }
+}
+
+void shmExporter::update(entry& E)
+{
+    volatile tblshm_param *P = E.shared;
+
+    // readers only copy the published slot.  A reader still copying
+    // 'next' from two updates ago must see the previous seq change
+    // before any of the new content.
+    epicsUInt32 next = P->slot^1u;
+    epicsAtomicWriteMemoryBarrier();
+    size_t count = E.copy(*E.param, m_base+P->offset[next], E.capacity);
+    epicsTimeStamp stamp = E.param->timestamp();
+
+    P->seq = P->seq+1u; // odd
+    epicsAtomicWriteMemoryBarrier();
+    P->slot = next;
+    P->count = count;
+    P->severity = E.param->severity();
+    P->sec = stamp.secPastEpoch;
+    P->nsec = stamp.nsec;
+    epicsAtomicWriteMemoryBarrier();
+    P->seq = P->seq+1u; // even
+}
+
+} // namespace paramTable
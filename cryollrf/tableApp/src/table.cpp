@@ -1,19 +1,37 @@
 
 
 #include <stdexcept>
+#include <algorithm>
 
 #include <epicsStdio.h>
 #include <epicsThread.h>
+#include <epicsTimer.h>
 
 #include <errlog.h>
 
 #include "paramtable/table.h"
 #include "paramtable/valueBase.h"
+#include "paramtable/lockstats.h"
+#include "paramtable/transaction.h"
 
 static enum {iocStopped=0, iocRunning} iocState;
 
 namespace paramTable {
 
+namespace {
+// Adds the time until destruction to a dispatchCost
+struct costTimer {
+    detail::dispatchCost& C;
+    const epicsUInt64 begin;
+    explicit costTimer(detail::dispatchCost& c) :C(c), begin(epicsMonotonicGet()) {}
+    ~costTimer()
+    {
+        C.calls++;
+        C.elapsed += epicsMonotonicGet()-begin;
+    }
+};
+} // namespace
+
 /** Create a new root table.
  *
  * This table instance will have an independent lock
@@ -22,11 +40,23 @@ table::table(const std::string& instname)
     :m_instancename(instname)
     ,m_parent()
     ,m_guard(new epicsMutex())
+    ,m_params()
     ,m_paramlookup()
     ,m_cleanup()
-    ,m_changelist()
+    ,m_changedHead(0)
+    ,m_changedTail(0)
     ,m_active(false)
+    ,m_traceMask(0)
+    ,m_traceLevel(0)
     ,m_globalListeners()
+    ,m_changesetListeners()
+    ,m_changeset()
+    ,m_changesetStampSet(false)
+    ,m_staging(0)
+    ,m_deferred()
+    ,m_flusher(0)
+    ,m_lockProfile(0)
+    ,m_lockStats(0)
 {init();}
 
 /** Create a dependent table
@@ -38,30 +68,91 @@ table::table(table& parent, const std::string& instname)
     :m_instancename(instname)
     ,m_parent(parent.shared_from_this())
     ,m_guard(parent.m_guard)
+    ,m_params()
     ,m_paramlookup()
     ,m_cleanup()
-    ,m_changelist()
+    ,m_changedHead(0)
+    ,m_changedTail(0)
     ,m_active(false)
+    ,m_traceMask(0)
+    ,m_traceLevel(0)
     ,m_globalListeners()
+    ,m_changesetListeners()
+    ,m_changeset()
+    ,m_changesetStampSet(false)
+    ,m_staging(0)
+    ,m_deferred()
+    ,m_flusher(0)
+    ,m_lockProfile(0)
+    ,m_lockStats(0)
 {init();}
 
 void table::init()
 {
+    m_changeset.source = this;
+
     tableOnce();
-    
-    Guard g(tableSingleton->tablesGuard);
 
     // This test is redundent to registerTable() but is done anyway
     // to catch this before the sub-class ctor gets too far.
-    if(tableSingleton->tables.find(m_instancename)!=tableSingleton->tables.end())
+    if(getTable(m_instancename))
         throw std::runtime_error("Table name already in use");
 
 }
 
+/* Notifies parameters held back by valueBase::setMaxRate()
+ * once their interval has elapsed.  One timer per table,
+ * started for the earliest due.
+ */
+struct table::flusher : public epicsTimerNotify
+{
+    table& owner;
+    epicsTimerQueueActive& queue;
+    epicsTimer& timer;
+    epicsUInt64 due; // zero when not started
+
+    flusher(table& t)
+        :owner(t)
+        ,queue(epicsTimerQueueActive::allocate(true))
+        ,timer(queue.createTimer())
+        ,due(0)
+    {}
+    virtual ~flusher()
+    {
+        timer.destroy(); // waits for expire()
+        queue.release();
+    }
+
+    // call with table lock held
+    void schedule(epicsUInt64 when, epicsUInt64 now)
+    {
+        if(due && due<=when)
+            return;
+        due = when;
+        timer.start(*this, when>now ? (when-now)*1e-9 : 0.0);
+    }
+
+    virtual expireStatus expire(const epicsTime&)
+    {
+        tableGuard g(owner, lockSiteTimer);
+        due = 0;
+        try {
+            owner.flushDeferred();
+        }catch(std::exception& e){
+            errlogPrintf("%s: Error flushing rate limited parameters: %s\n",
+                         owner.name().c_str(), e.what());
+        }
+        return noRestart;
+    }
+};
+
 table::~table()
 {
     while(!m_cleanup.empty())
         delete *m_cleanup.begin();
+    delete m_flusher;
+    delete m_lockStats;
+    delete m_staging;
 }
 
 /** @brief Transfer ownership of this valueBase
@@ -77,6 +168,8 @@ void table::addParam(valueBase* param, bool cleanup)
         m += " already registered";
         throw std::logic_error(m);
     }
+    param->m_index = m_params.size();
+    m_params.push_back(param);
     m_paramlookup[param->name()]=param;
     if(cleanup)
         m_cleanup.push_back(param);
@@ -86,20 +179,38 @@ void table::registerTable()
 {
     Guard g(tableSingleton->tablesGuard);
 
-    if(tableSingleton->tables.find(m_instancename)!=tableSingleton->tables.end())
+    tableSingle::snapshot_t cur(tableSingleton->snapshot());
+    tableSingle::tables_t::const_iterator it = tableSingle::lowerBound(*cur, m_instancename);
+    if(it!=cur->end() && it->first==m_instancename)
         throw std::runtime_error("Table name already registered");
 
+    std::tr1::shared_ptr<tableSingle::tables_t> next(new tableSingle::tables_t);
+    next->reserve(cur->size()+1);
+    next->insert(next->end(), cur->begin(), it);
+    next->push_back(tableSingle::entry_t(m_instancename, shared_from_this()));
+    next->insert(next->end(), it, cur->end());
+
     if(iocState==iocRunning)
         iocStart();
 
-    tableSingleton->tables[m_instancename]=shared_from_this();
+    cur.reset();
+    tableSingleton->replace(next);
 }
 
 void table::unregisterTable()
 {
     Guard g(tableSingleton->tablesGuard);
 
-    tableSingleton->tables.erase(m_instancename);
+    {
+        tableSingle::snapshot_t cur(tableSingleton->snapshot());
+        std::tr1::shared_ptr<tableSingle::tables_t> next(new tableSingle::tables_t);
+        next->reserve(cur->size());
+        for(tableSingle::tables_t::const_iterator it=cur->begin(); it!=cur->end(); ++it)
+            if(it->first!=m_instancename)
+                next->push_back(*it);
+        cur.reset();
+        tableSingleton->replace(next);
+    }
 
     if(iocState==iocStopped)
         return; // already handled in exit hook
@@ -107,6 +218,19 @@ void table::unregisterTable()
     iocStop();
 }
 
+static
+bool nameLess(const valueBase* a, const valueBase* b)
+{
+    return a->name()<b->name();
+}
+
+std::vector<valueBase*> table::paramsByName() const
+{
+    std::vector<valueBase*> ret(m_params);
+    std::sort(ret.begin(), ret.end(), &nameLess);
+    return ret;
+}
+
 /** @brief Run-time addition of parameters
  *
  * Sub-classes may implement this method to allow dynamic
@@ -149,7 +273,59 @@ valueBase& table::findBase(const std::string& n) const
 
 void table::markChanged(valueBase& p)
 {
-    m_changelist.push_back(&p);
+    // p is not already queued.  See valueBase::markChanged()
+    p.m_nextChanged = 0;
+    if(m_changedTail)
+        m_changedTail->m_nextChanged = &p;
+    else
+        m_changedHead = &p;
+    m_changedTail = &p;
+}
+
+void table::defer(valueBase& p, epicsUInt64 due, epicsUInt64 now)
+{
+    m_deferred.push_back(&p);
+    if(!m_flusher)
+        m_flusher = new flusher(*this);
+    m_flusher->schedule(due, now);
+}
+
+void table::undefer(valueBase& p)
+{
+    std::vector<valueBase*>::iterator it = std::find(m_deferred.begin(), m_deferred.end(), &p);
+    if(it!=m_deferred.end()) {
+        *it = m_deferred.back();
+        m_deferred.pop_back();
+    }
+    p.m_throttle->deferred = false;
+}
+
+// from flush timer, with lock held
+void table::flushDeferred()
+{
+    epicsUInt64 now = epicsMonotonicGet(), next = 0;
+    bool queued = false;
+
+    for(size_t i=0; i<m_deferred.size(); ) {
+        valueBase *p = m_deferred[i];
+        epicsUInt64 due = p->m_throttle->last+p->m_throttle->interval;
+        if(due<=now) {
+            m_deferred[i] = m_deferred.back();
+            m_deferred.pop_back();
+            p->m_throttle->deferred = false;
+            markChanged(*p); // still m_changed, but not queued
+            queued = true;
+        } else {
+            if(!next || due<next)
+                next = due;
+            i++;
+        }
+    }
+
+    if(next)
+        m_flusher->schedule(next, now);
+    if(queued)
+        dispatch();
 }
 
 /** Consume list of changed parameters and invoke listener callbacks.
@@ -164,27 +340,96 @@ void table::dispatch()
         return;
     flagGuard f(m_active);
 
+    const epicsUInt64 start = m_lockProfile ? epicsMonotonicGet() : 0u;
+
     bool err=false;
     std::string firsterr;
+    size_t notified=0;
 
-    while(!m_changelist.empty()) {
-        valueBase *cur = m_changelist.front();
-        m_changelist.pop_front();
+    // changeset listeners may change more parameters
+    while(m_changedHead) {
+        const bool collect = m_changesetListeners.size()!=0;
+        changeset& C = m_changeset;
 
-        try{
-            cur->dispatch();
-        }catch(std::exception& e){
-            if(!err) {
-                err=true;
-                firsterr="Error during dispatch: ";
-                firsterr+=e.what();
+        if(collect) {
+            C.bits.resize((m_params.size()+31u)/32u, 0u);
+            C.indices.clear();
+        }
+
+        while(m_changedHead) {
+            valueBase *cur = m_changedHead;
+            m_changedHead = cur->m_nextChanged;
+            if(!m_changedHead)
+                m_changedTail = 0;
+            cur->m_nextChanged = 0;
+
+            if(cur->m_throttle && cur->m_changed && cur->holdNotify())
+                continue; // notified later by m_flusher
+
+            notified++;
+            TBL_TRACE(*this, traceDispatch, 3, "notify %s", cur->name().c_str());
+
+            if(collect) {
+                // a parameter may be changed again by a listener
+                size_t i = cur->index();
+                epicsUInt32 mask = 1u<<(i%32u);
+                if(!(C.bits[i/32u]&mask)) {
+                    C.bits[i/32u] |= mask;
+                    C.indices.push_back(i);
+                }
             }
+
+            try{
+                if(!detail::dispatchAccounting) {
+                    cur->dispatch();
+                } else {
+                    size_t i = cur->index();
+                    if(m_dispatchCosts.size()<=i)
+                        m_dispatchCosts.resize(m_params.size());
+                    costTimer T(m_dispatchCosts[i]);
+                    cur->dispatch();
+                }
+            }catch(std::exception& e){
+                if(!err) {
+                    err=true;
+                    firsterr="Error during dispatch: ";
+                    firsterr+=e.what();
+                }
+            }
+
+            // more parameters may have been changed by dispatch()
+
+            // dispatch() clears m_changed
         }
 
-        // more parameters may have been changed by dispatch()
+        if(collect) {
+            if(!m_changesetStampSet)
+                C.timestamp = epicsTime::getCurrent();
+
+            try{
+                m_changesetListeners(C);
+            }catch(std::exception& e){
+                if(!err) {
+                    err=true;
+                    firsterr="Error during changeset dispatch: ";
+                    firsterr+=e.what();
+                }
+            }
 
-        // dispatch() clears m_changed
+            // clear only the bits set
+            for(size_t n=0; n<C.indices.size(); n++)
+                C.bits[C.indices[n]/32u] = 0u;
+            C.indices.clear();
+        }
+        m_changesetStampSet = false;
     }
+    m_changesetStampSet = false;
+
+    if(notified)
+        TBL_TRACE(*this, traceDispatch, 2, "dispatched %u parameters", (unsigned)notified);
+
+    if(start && m_lockStats)
+        m_lockStats->dispatch.add(epicsMonotonicGet()-start);
 
     if(err)
         throw std::runtime_error(firsterr);
@@ -233,13 +478,21 @@ void startTable(const paramTable::table::shared_pointer& tbl)
 void table::tableStart()
 {
     tableOnce();
-    Guard g(tableSingleton->tablesGuard);
+    // Taken with the state change, so that each table is started exactly
+    // once, either here or by registerTable()
+    tableSingle::snapshot_t cur;
+    {
+        Guard g(tableSingleton->tablesGuard);
 
-    if(iocState==iocRunning)
-        return;
+        if(iocState==iocRunning)
+            return;
+        // tables registered from now on are started by registerTable()
+        iocState=iocRunning;
+        cur = tableSingleton->snapshot();
+    }
 
-    paramTable::table::visitTables(&startTable);
-    iocState=iocRunning;
+    for(tableSingle::tables_t::const_iterator it=cur->begin(); it!=cur->end(); ++it)
+        startTable(it->second);
 }
 
 static
@@ -258,15 +511,21 @@ void stopTable(const paramTable::table::shared_pointer& tbl)
 void table::tableStop()
 {
     tableOnce();
-    Guard g(tableSingleton->tablesGuard);
+    // Taken with the state change.  See tableStart()
+    tableSingle::snapshot_t cur;
+    {
+        Guard g(tableSingleton->tablesGuard);
 
-    if(iocState!=iocRunning) {
+        if(iocState!=iocRunning) {
+            iocState=iocStopped;
+            return;
+        }
         iocState=iocStopped;
-        return;
+        cur = tableSingleton->snapshot();
     }
-    iocState=iocStopped;
 
-    paramTable::table::visitTables(&stopTable);
+    for(tableSingle::tables_t::const_iterator it=cur->begin(); it!=cur->end(); ++it)
+        stopTable(it->second);
 }
 
 bool table::tableRunning()
@@ -288,24 +547,65 @@ void table::tableOnce(void* raw)
     }
 }
 
+table::tableSingle::snapshot_t table::tableSingle::snapshot()
+{
+    Guard g(snapshotGuard);
+    return tables;
+}
+
+void table::tableSingle::replace(const snapshot_t& next)
+{
+    snapshot_t prev;
+    {
+        Guard g(snapshotGuard);
+        prev = tables;
+        tables = next;
+    }
+    // readers may still hold 'prev', which is released by the last of them
+}
+
+namespace {
+struct entryLess {
+    bool operator()(const std::pair<std::string, std::tr1::shared_ptr<table> >& e, const std::string& n) const
+    { return e.first<n; }
+};
+}
+
+table::tableSingle::tables_t::const_iterator
+table::tableSingle::lowerBound(const tables_t& T, const std::string& name)
+{
+    return std::lower_bound(T.begin(), T.end(), name, entryLess());
+}
+
+table::tableSingle::tables_t::const_iterator
+table::tableSingle::find(const tables_t& T, const std::string& name)
+{
+    tables_t::const_iterator it = lowerBound(T, name);
+    if(it!=T.end() && it->first!=name)
+        return T.end();
+    return it;
+}
+
 std::tr1::shared_ptr<table> table::getTable(const std::string& inst)
 {
     tableOnce();
-    Guard g(tableSingleton->tablesGuard);
+    tableSingle::snapshot_t cur(tableSingleton->snapshot());
 
-    tableSingle::tables_t::const_iterator it=
-            tableSingleton->tables.find(inst);
-    if(it==tableSingleton->tables.end())
+    tableSingle::tables_t::const_iterator it = tableSingle::find(*cur, inst);
+    if(it==cur->end())
         return std::tr1::shared_ptr<table>();
     else
         return it->second;
 }
 
+/** Iterates the tables registered when called.  The visitor is called without
+ * any global lock, and may register or lookup tables.
+ */
 void table::visitTables(const std::tr1::function<void(const shared_pointer&)>& a) {
     tableOnce();
-    Guard g(tableSingleton->tablesGuard);
-    for(tableSingle::tables_t::const_iterator it=tableSingleton->tables.begin();
-        it!=tableSingleton->tables.end();
+    tableSingle::snapshot_t cur(tableSingleton->snapshot());
+    for(tableSingle::tables_t::const_iterator it=cur->begin();
+        it!=cur->end();
         ++it)
     {
         a(it->second);
@@ -321,7 +621,7 @@ void table::clearTables()
     tableOnce();
     Guard g(tableSingleton->tablesGuard);
 
-    tableSingleton->tables.clear();
+    tableSingleton->replace(tableSingle::snapshot_t(new tableSingle::tables_t));
 }
 
 namespace detail {
@@ -1,8 +1,11 @@
 
 
 #include <cstdio>
+#include <cstring>
 #include <stdexcept>
 #include <sstream>
+#include <vector>
+#include <memory>
 
 #include <drvSup.h>
 #include <initHooks.h>
@@ -11,6 +14,9 @@
 
 #include "paramtable/table.h"
 #include "paramtable/valueBase.h"
+#include "paramtable/async.h"
+#include "paramtable/lockstats.h"
+#include "paramtable/shmexport.h"
 
 #ifndef VERSION_INT
 #  define VERSION_INT(V,R,M,P) ( ((V)<<24) | ((R)<<16) | ((M)<<8) | (P))
@@ -26,9 +32,22 @@ static void tableInfo(const paramTable::table::shared_pointer& t)
         epicsPrintf("%s has %lu dangling references\n", t->name().c_str(), t.use_count()-1);
 }
 
+namespace {
+// created by tblShmExport.  Holds a reference to the table
+struct shmExport {
+    paramTable::table::shared_pointer tbl;
+    paramTable::shmExporter *exporter;
+};
+std::vector<shmExport> shmExports;
+}
+
 extern "C" void paramTableShutdown(void*)
 {
     paramTable::table::tableStop();
+    paramTable::asyncShutdown();
+    for(size_t i=0; i<shmExports.size(); i++)
+        delete shmExports[i].exporter;
+    shmExports.clear();
     paramTable::table::visitTables(&tableInfo);
     paramTable::table::clearTables();
 }
@@ -83,7 +102,7 @@ void showParam(valueBase* p)
 {
     std::ostringstream strm;
     {
-        Guard g(p->getTable().mutex());
+        tableGuard g(p->getTable(), lockSiteIocsh);
         p->show(strm);
     }
     strm<<"\n";
@@ -121,6 +140,195 @@ try{
 }
 }
 
+extern "C"
+void tblTrace(const char* n, int mask, int level)
+{
+try{
+    using paramTable::table;
+    if(!n) {
+        paramTable::traceFlush();
+        return;
+    }
+    table::shared_pointer tbl = table::getTable(n);
+    if(!tbl) {
+        errlogPrintf("No such name: '%s'\n", n);
+        return;
+    }
+    tbl->setTrace((unsigned)mask, level);
+}catch(std::exception& e){
+    errlogPrintf("tblTrace: %s\n", e.what());
+}
+}
+
+namespace {
+struct lockStatsShow {
+    bool reset;
+    void operator()(const paramTable::table::shared_pointer& t)
+    {
+        if(!t->lockProfile())
+            return;
+        std::ostringstream strm;
+        t->showLockStats(strm, reset);
+        printf("%s", strm.str().c_str());
+    }
+};
+struct lockProfileSet {
+    bool enable;
+    void operator()(const paramTable::table::shared_pointer& t)
+    {
+        t->setLockProfile(enable);
+    }
+};
+} // namespace
+
+/* Enable lock profiling of the named table, or all tables if the
+ * name is omitted or "*"
+ */
+extern "C"
+void tblLockProfile(const char* n, int enable)
+{
+try{
+    using paramTable::table;
+    if(!n || !*n || strcmp(n, "*")==0) {
+        lockProfileSet op;
+        op.enable = enable!=0;
+        table::visitTables(op);
+        return;
+    }
+    table::shared_pointer tbl = table::getTable(n);
+    if(!tbl) {
+        errlogPrintf("No such name: '%s'\n", n);
+        return;
+    }
+    tbl->setLockProfile(enable!=0);
+}catch(std::exception& e){
+    errlogPrintf("tblLockProfile: %s\n", e.what());
+}
+}
+
+/* Print lock profile of the named table, or of all profiled tables */
+extern "C"
+void tblLockStats(const char* n, int reset)
+{
+try{
+    using paramTable::table;
+    if(!n || !*n || strcmp(n, "*")==0) {
+        lockStatsShow op;
+        op.reset = reset!=0;
+        table::visitTables(op);
+        return;
+    }
+    table::shared_pointer tbl = table::getTable(n);
+    if(!tbl) {
+        errlogPrintf("No such name: '%s'\n", n);
+        return;
+    }
+    std::ostringstream strm;
+    tbl->showLockStats(strm, reset!=0);
+    printf("%s", strm.str().c_str());
+}catch(std::exception& e){
+    errlogPrintf("tblLockStats: %s\n", e.what());
+}
+}
+
+namespace {
+struct dispatchCostShow {
+    size_t count;
+    bool reset;
+    void operator()(const paramTable::table::shared_pointer& t)
+    {
+        std::ostringstream strm;
+        t->showDispatchCosts(strm, count, reset);
+        printf("%s", strm.str().c_str());
+    }
+};
+} // namespace
+
+/* Enable or disable dispatch cost accounting for all tables */
+extern "C"
+void tblDispatchAccounting(int enable)
+{
+    paramTable::table::setDispatchAccounting(enable!=0);
+}
+
+/* Print the most expensive parameters and subscribers of the named table,
+ * or of all tables
+ */
+extern "C"
+void tblDispatchStats(const char* n, int count, int reset)
+{
+try{
+    using paramTable::table;
+    dispatchCostShow op;
+    op.count = count<=0 ? 10u : size_t(count);
+    op.reset = reset!=0;
+    if(!n || !*n || strcmp(n, "*")==0) {
+        table::visitTables(op);
+        return;
+    }
+    table::shared_pointer tbl = table::getTable(n);
+    if(!tbl) {
+        errlogPrintf("No such name: '%s'\n", n);
+        return;
+    }
+    op(tbl);
+}catch(std::exception& e){
+    errlogPrintf("tblDispatchStats: %s\n", e.what());
+}
+}
+
+/* Mirror the listed parameters (comma separated, or "*" for all which
+ * can be) of a table into a POSIX shared memory segment.  See tblshm.h
+ */
+extern "C"
+void tblShmExport(const char* n, const char* shmname, const char* params, int maxelem)
+{
+try{
+    using paramTable::table;
+    if(!n || !shmname || !shmname[0] || !params) {
+        errlogPrintf("Usage: tblShmExport <table> <shm name> <param,param,...|*> [max elements]\n");
+        return;
+    }
+    table::shared_pointer tbl = table::getTable(n);
+    if(!tbl) {
+        errlogPrintf("No such name: '%s'\n", n);
+        return;
+    }
+    std::string shm(shmname);
+    if(shm[0]!='/')
+        shm = "/"+shm;
+    std::auto_ptr<paramTable::shmExporter> X(new paramTable::shmExporter(*tbl, shm));
+    size_t capacity = maxelem>0 ? size_t(maxelem) : 0u;
+
+    paramTable::Guard g(tbl->mutex());
+    if(strcmp(params, "*")==0) {
+        for(size_t i=0; i<tbl->paramCount(); i++) {
+            if(paramTable::shmExporter::supported(tbl->param(i)))
+                X->add(tbl->param(i).name(), capacity);
+        }
+    } else {
+        std::string list(params);
+        size_t start = 0;
+        while(start<=list.size()) {
+            size_t end = list.find(',', start);
+            if(end==std::string::npos)
+                end = list.size();
+            if(end>start)
+                X->add(list.substr(start, end-start), capacity);
+            start = end+1;
+        }
+    }
+    X->start();
+
+    shmExport E;
+    E.tbl = tbl;
+    E.exporter = X.release();
+    shmExports.push_back(E);
+}catch(std::exception& e){
+    errlogPrintf("tblShmExport: %s\n", e.what());
+}
+}
+
 static
 void showTable(int lvl)
 {
@@ -156,12 +364,90 @@ static void showtblCallFunc(const iocshArgBuf *args)
     errlogFlush();
 }
 
+static const iocshArg tblTraceArg0 = { "name",iocshArgString};
+static const iocshArg tblTraceArg1 = { "mask",iocshArgInt};
+static const iocshArg tblTraceArg2 = { "level",iocshArgInt};
+static const iocshArg * const tblTraceArgs[] = {&tblTraceArg0,&tblTraceArg1,&tblTraceArg2};
+static const iocshFuncDef tblTraceFuncDef = {"tblTrace",3,tblTraceArgs};
+static void tblTraceCallFunc(const iocshArgBuf *args)
+{
+    tblTrace(args[0].sval, args[1].ival, args[2].ival);
+    errlogFlush();
+}
+
+static const iocshArg tblAsyncWorkersArg0 = { "count",iocshArgInt};
+static const iocshArg * const tblAsyncWorkersArgs[] = {&tblAsyncWorkersArg0};
+static const iocshFuncDef tblAsyncWorkersFuncDef = {"tblAsyncWorkers",1,tblAsyncWorkersArgs};
+static void tblAsyncWorkersCallFunc(const iocshArgBuf *args)
+{
+    paramTable::asyncSetWorkers(args[0].ival<0 ? 0 : args[0].ival);
+    errlogFlush();
+}
+
+static const iocshArg tblLockProfileArg0 = { "name",iocshArgString};
+static const iocshArg tblLockProfileArg1 = { "enable",iocshArgInt};
+static const iocshArg * const tblLockProfileArgs[] = {&tblLockProfileArg0,&tblLockProfileArg1};
+static const iocshFuncDef tblLockProfileFuncDef = {"tblLockProfile",2,tblLockProfileArgs};
+static void tblLockProfileCallFunc(const iocshArgBuf *args)
+{
+    tblLockProfile(args[0].sval, args[1].ival);
+    errlogFlush();
+}
+
+static const iocshArg tblLockStatsArg0 = { "name",iocshArgString};
+static const iocshArg tblLockStatsArg1 = { "reset",iocshArgInt};
+static const iocshArg * const tblLockStatsArgs[] = {&tblLockStatsArg0,&tblLockStatsArg1};
+static const iocshFuncDef tblLockStatsFuncDef = {"tblLockStats",2,tblLockStatsArgs};
+static void tblLockStatsCallFunc(const iocshArgBuf *args)
+{
+    tblLockStats(args[0].sval, args[1].ival);
+    errlogFlush();
+}
+
+static const iocshArg tblDispatchAccountingArg0 = { "enable",iocshArgInt};
+static const iocshArg * const tblDispatchAccountingArgs[] = {&tblDispatchAccountingArg0};
+static const iocshFuncDef tblDispatchAccountingFuncDef = {"tblDispatchAccounting",1,tblDispatchAccountingArgs};
+static void tblDispatchAccountingCallFunc(const iocshArgBuf *args)
+{
+    tblDispatchAccounting(args[0].ival);
+}
+
+static const iocshArg tblDispatchStatsArg0 = { "name",iocshArgString};
+static const iocshArg tblDispatchStatsArg1 = { "count",iocshArgInt};
+static const iocshArg tblDispatchStatsArg2 = { "reset",iocshArgInt};
+static const iocshArg * const tblDispatchStatsArgs[] = {&tblDispatchStatsArg0,&tblDispatchStatsArg1,&tblDispatchStatsArg2};
+static const iocshFuncDef tblDispatchStatsFuncDef = {"tblDispatchStats",3,tblDispatchStatsArgs};
+static void tblDispatchStatsCallFunc(const iocshArgBuf *args)
+{
+    tblDispatchStats(args[0].sval, args[1].ival, args[2].ival);
+    errlogFlush();
+}
+
+static const iocshArg tblShmExportArg0 = { "table",iocshArgString};
+static const iocshArg tblShmExportArg1 = { "shm name",iocshArgString};
+static const iocshArg tblShmExportArg2 = { "params",iocshArgString};
+static const iocshArg tblShmExportArg3 = { "max elements",iocshArgInt};
+static const iocshArg * const tblShmExportArgs[] = {&tblShmExportArg0,&tblShmExportArg1,&tblShmExportArg2,&tblShmExportArg3};
+static const iocshFuncDef tblShmExportFuncDef = {"tblShmExport",4,tblShmExportArgs};
+static void tblShmExportCallFunc(const iocshArgBuf *args)
+{
+    tblShmExport(args[0].sval, args[1].sval, args[2].sval, args[3].ival);
+    errlogFlush();
+}
+
 static
 void paramtableRegister(void)
 {
     paramTable::table::tableOnce();
     iocshRegister(&lstblFuncDef,lstblCallFunc);
     iocshRegister(&showtblFuncDef,showtblCallFunc);
+    iocshRegister(&tblTraceFuncDef,tblTraceCallFunc);
+    iocshRegister(&tblAsyncWorkersFuncDef,tblAsyncWorkersCallFunc);
+    iocshRegister(&tblLockProfileFuncDef,tblLockProfileCallFunc);
+    iocshRegister(&tblLockStatsFuncDef,tblLockStatsCallFunc);
+    iocshRegister(&tblDispatchAccountingFuncDef,tblDispatchAccountingCallFunc);
+    iocshRegister(&tblDispatchStatsFuncDef,tblDispatchStatsCallFunc);
+    iocshRegister(&tblShmExportFuncDef,tblShmExportCallFunc);
     initHookRegister(&paramTableInitHook);
     epicsAtExit(&paramTableShutdown,0);
 }
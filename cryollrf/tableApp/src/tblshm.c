@@ -0,0 +1,151 @@
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tblshm.h"
+
+#define READ_TRIES 1000
+
+/* Order loads of the sequence counter and the data */
+#define rmb() __sync_synchronize()
+
+struct tblshm {
+    const char *base;
+    size_t size;
+};
+
+static
+const tblshm_param* param(const tblshm *S, unsigned index)
+{
+    const tblshm_header *H = (const tblshm_header*)S->base;
+    if(index>=H->nparams)
+        return NULL;
+    return (const tblshm_param*)(S->base + sizeof(tblshm_header)) + index;
+}
+
+tblshm* tblshm_open(const char *name)
+{
+    tblshm *S;
+    struct stat info;
+    const tblshm_header *H;
+    void *base;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if(fd<0)
+        return NULL;
+
+    if(fstat(fd, &info)!=0 || (size_t)info.st_size<sizeof(tblshm_header)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    base = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base==MAP_FAILED)
+        return NULL;
+
+    H = (const tblshm_header*)base;
+    if(H->magic!=TBLSHM_MAGIC || H->version!=TBLSHM_VERSION
+            || H->param_size!=sizeof(tblshm_param)
+            || H->total_size>(uint64_t)info.st_size) {
+        munmap(base, info.st_size);
+        errno = EPROTO;
+        return NULL;
+    }
+
+    S = malloc(sizeof(*S));
+    if(!S) {
+        munmap(base, info.st_size);
+        errno = ENOMEM;
+        return NULL;
+    }
+    S->base = base;
+    S->size = info.st_size;
+    return S;
+}
+
+void tblshm_close(tblshm *S)
+{
+    if(!S)
+        return;
+    munmap((void*)S->base, S->size);
+    free(S);
+}
+
+const tblshm_header* tblshm_info(const tblshm *S)
+{
+    return (const tblshm_header*)S->base;
+}
+
+int tblshm_find(const tblshm *S, const char *name)
+{
+    const tblshm_header *H = (const tblshm_header*)S->base;
+    unsigned i;
+    for(i=0; i<H->nparams; i++) {
+        if(strncmp(param(S, i)->name, name, sizeof(((tblshm_param*)0)->name))==0)
+            return (int)i;
+    }
+    return -1;
+}
+
+const tblshm_param* tblshm_param_info(const tblshm *S, unsigned index)
+{
+    return param(S, index);
+}
+
+uint32_t tblshm_seq(const tblshm *S, unsigned index)
+{
+    const tblshm_param *P = param(S, index);
+    uint32_t seq;
+    if(!P)
+        return 0;
+    seq = *(volatile const uint32_t*)&P->seq;
+    rmb();
+    return seq;
+}
+
+int tblshm_read(const tblshm *S, unsigned index, void *buf, size_t nelem, tblshm_meta *meta)
+{
+    const volatile tblshm_param *P = param(S, index);
+    unsigned tries;
+    if(!P)
+        return -1;
+
+    for(tries=0; tries<READ_TRIES; tries++) {
+        uint32_t seq = P->seq, slot, count, n;
+        tblshm_meta M;
+        rmb();
+        if(seq&1u)
+            continue; /* update in progress */
+
+        slot = P->slot;
+        count = P->count;
+        M.severity = P->severity;
+        M.sec = P->sec;
+        M.nsec = P->nsec;
+        if(slot>1u || count>P->capacity)
+            continue; /* torn */
+
+        n = count<nelem ? count : (uint32_t)nelem;
+        memcpy(buf, S->base + P->offset[slot], (size_t)n*P->elem_size);
+
+        rmb();
+        if(P->seq!=seq)
+            continue;
+
+        if(meta) {
+            M.seq = seq;
+            M.count = count;
+            *meta = M;
+        }
+        return (int)n;
+    }
+    errno = EAGAIN;
+    return -1;
+}
@@ -0,0 +1,108 @@
+#ifndef TBLSHM_H
+#define TBLSHM_H
+
+/* Reader for parameter tables exported to POSIX shared memory.
+ *
+ * An IOC exports selected parameters of a table with the iocsh command
+ *
+ *   tblShmExport <table> <shm name> <param,param,...|*> [max elements]
+ *
+ * Same host processes may then read them without Channel Access.
+ * The segment is created by the IOC and only ever mapped read-only here.
+ *
+ * Each parameter has a sequence counter, which is odd while an update is
+ * in progress, and two data slots.  The IOC writes new data into the
+ * slot not currently published.  tblshm_read() retries if the
+ * counter changes while copying.
+ *
+ * Plain C with no EPICS dependency, for use from eg. Python (ctypes).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TBLSHM_MAGIC   0x54424c53u /* "TBLS" */
+#define TBLSHM_VERSION 1u
+
+/* Element type of a parameter */
+typedef enum {
+    tblshmUInt32 = 1,
+    tblshmInt32,
+    tblshmFloat64,
+    tblshmUInt8Array,
+    tblshmInt8Array,
+    tblshmUInt16Array,
+    tblshmInt16Array,
+    tblshmUInt32Array,
+    tblshmInt32Array,
+    tblshmFloat32Array,
+    tblshmFloat64Array
+} tblshm_type;
+
+/* Layout.  Header, then nparams tblshm_param, then data slots */
+typedef struct tblshm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nparams;
+    uint32_t param_size;  /* sizeof(tblshm_param) */
+    uint64_t total_size;  /* of the segment */
+    uint64_t generation;  /* changes each time the segment is (re)created */
+    char table[32];       /* table name, nil terminated */
+} tblshm_header;
+
+typedef struct tblshm_param {
+    char name[64];        /* nil terminated */
+    uint32_t type;        /* tblshm_type */
+    uint32_t elem_size;   /* bytes */
+    uint32_t capacity;    /* elements per slot */
+    uint32_t seq;         /* even when stable.  Incremented twice per update */
+    uint32_t slot;        /* 0 or 1.  Slot of the current data */
+    uint32_t count;       /* elements in the current slot */
+    int32_t severity;     /* EPICS alarm severity.  3 is INVALID */
+    uint32_t sec;         /* time stamp, EPICS epoch (1990) */
+    uint32_t nsec;
+    uint32_t reserved0;
+    uint64_t offset[2];   /* of each slot from the start of the segment */
+    uint32_t reserved1[2];
+} tblshm_param;
+
+/* Meta-data of one update, returned by tblshm_read() */
+typedef struct tblshm_meta {
+    uint32_t seq;
+    uint32_t count;       /* elements available, may exceed the number copied */
+    int32_t severity;
+    uint32_t sec, nsec;
+} tblshm_meta;
+
+typedef struct tblshm tblshm;
+
+/* Map an existing segment (eg. "/DRFM1").  Returns NULL and sets errno on failure */
+tblshm* tblshm_open(const char *name);
+void tblshm_close(tblshm *S);
+
+const tblshm_header* tblshm_info(const tblshm *S);
+
+/* Index of the named parameter, or -1 */
+int tblshm_find(const tblshm *S, const char *param);
+
+const tblshm_param* tblshm_param_info(const tblshm *S, unsigned index);
+
+/* Current sequence counter.  Changes when the parameter is updated */
+uint32_t tblshm_seq(const tblshm *S, unsigned index);
+
+/* Copy a consistent snapshot of up to 'nelem' elements into 'buf'.
+ * 'meta' may be NULL.
+ * Returns the number of elements copied, or -1 if a consistent copy
+ * could not be made (index out of range, or the writer is too fast).
+ */
+int tblshm_read(const tblshm *S, unsigned index, void *buf, size_t nelem, tblshm_meta *meta);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TBLSHM_H */
@@ -0,0 +1,297 @@
+
+#include <string.h>
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+#include <epicsThread.h>
+#include <epicsExit.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+#include <epicsAtomic.h>
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <errlog.h>
+
+#include "paramtable/trace.h"
+
+namespace paramTable {
+namespace {
+
+typedef epicsGuard<epicsMutex> Guard;
+
+struct traceRecord {
+    epicsTimeStamp stamp;
+    const char *source;
+    const char *fmt;
+    size_t nargs;
+    traceArg args[traceMaxArgs];
+};
+
+/* Single producer (the owning thread), single consumer (the trace thread).
+ * head is only written by the producer, tail only by the consumer.
+ *
+ * When the owning thread exits, 'released' is set and the trace thread
+ * returns the ring, once drained, to the free list for another thread.
+ */
+struct traceRing {
+    enum {size=1024}; // power of 2
+
+    traceRecord buf[size];
+    size_t head, tail;
+    size_t dropped;
+    int released;
+
+    std::string thread;
+
+    traceRing() :head(0), tail(0), dropped(0), released(0) {}
+
+    void push(const char *source, const char *fmt, size_t nargs, const traceArg *args)
+    {
+        size_t h = head,
+               t = epicsAtomicGetSizeT(&tail);
+        if(h-t >= size) {
+            epicsAtomicIncrSizeT(&dropped);
+            return;
+        }
+
+        traceRecord& R = buf[h&(size-1)];
+        epicsTimeGetCurrent(&R.stamp);
+        R.source = source;
+        R.fmt = fmt;
+        R.nargs = nargs<traceMaxArgs ? nargs : traceMaxArgs;
+        for(size_t i=0; i<R.nargs; i++)
+            R.args[i] = args[i];
+
+        epicsAtomicWriteMemoryBarrier();
+        epicsAtomicSetSizeT(&head, h+1);
+    }
+};
+
+void releaseRing(void *raw);
+
+struct traceGlobal : public epicsThreadRunable {
+    // Bound on memory used by rings.  Threads beyond this drop messages.
+    enum {maxRings=32};
+
+    epicsMutex lock; // guards rings, unused, and thread names.  Serializes drain()
+    std::vector<traceRing*> rings; // all allocated
+    std::vector<traceRing*> unused; // drained and not owned by a thread
+    size_t noring; // messages dropped for lack of a ring
+    epicsThreadPrivateId self;
+    epicsEvent wakeup;
+    epicsThread worker;
+
+    traceGlobal()
+        :noring(0)
+        ,self(epicsThreadPrivateCreate())
+        ,worker(*this, "paramTrace",
+                epicsThreadGetStackSize(epicsThreadStackSmall),
+                epicsThreadPriorityLow)
+    {
+        worker.start();
+    }
+    virtual ~traceGlobal() {}
+
+    // ring owned by the calling thread, or NULL if none are available
+    traceRing* ring()
+    {
+        traceRing *R = (traceRing*)epicsThreadPrivateGet(self);
+        if(!R) {
+            Guard g(lock);
+            if(!unused.empty()) {
+                R = unused.back();
+                unused.pop_back();
+            } else if(rings.size()<maxRings) {
+                R = new traceRing;
+                rings.push_back(R);
+            } else {
+                return 0;
+            }
+            R->thread = epicsThreadGetNameSelf();
+            epicsAtomicSetIntT(&R->released, 0);
+            epicsThreadPrivateSet(self, (void*)R);
+            epicsAtThreadExit(&releaseRing, (void*)R);
+        }
+        return R;
+    }
+
+    virtual void run()
+    {
+        while(true) {
+            wakeup.wait(0.1);
+            drain();
+        }
+    }
+
+    void drain();
+};
+
+traceGlobal *traceState;
+epicsThreadOnceId traceOnce = EPICS_THREAD_ONCE_INIT;
+
+// called by the owning thread as it exits, after its last push()
+void releaseRing(void *raw)
+{
+    traceRing *R = (traceRing*)raw;
+    epicsThreadPrivateSet(traceState->self, 0);
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetIntT(&R->released, 1);
+}
+
+void traceInit(void*)
+{
+    traceState = new traceGlobal;
+}
+
+/* Format one conversion of 'spec' (eg. "%-8lx") using the captured argument.
+ * Length modifiers in the format are replaced by those matching the captured type.
+ */
+void formatArg(std::string& out, const char *spec, size_t speclen, const traceArg& A)
+{
+    char conv = spec[speclen-1];
+    std::string S;
+    for(size_t i=0; i<speclen-1; i++) {
+        if(strchr("hlLqjzt", spec[i]))
+            continue;
+        S += spec[i];
+    }
+
+    char buf[64];
+    switch(conv) {
+    case 'd': case 'i':
+        S += 'l'; S += conv;
+        epicsSnprintf(buf, sizeof(buf), S.c_str(),
+                      A.kind==traceArg::Double ? long(A.v.d) : A.v.i);
+        break;
+    case 'o': case 'u': case 'x': case 'X': case 'c':
+        if(conv!='c') S += 'l';
+        S += conv;
+        epicsSnprintf(buf, sizeof(buf), S.c_str(),
+                      A.kind==traceArg::Double ? (unsigned long)A.v.d : A.v.u);
+        break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+        S += conv;
+        epicsSnprintf(buf, sizeof(buf), S.c_str(),
+                      A.kind==traceArg::Double ? A.v.d : double(A.v.i));
+        break;
+    case 's':
+        S += conv;
+        epicsSnprintf(buf, sizeof(buf), S.c_str(),
+                      A.kind==traceArg::String && A.v.s ? A.v.s : "<?>");
+        break;
+    case 'p':
+        S += conv;
+        epicsSnprintf(buf, sizeof(buf), S.c_str(), A.v.p);
+        break;
+    default:
+        epicsSnprintf(buf, sizeof(buf), "<?%c>", conv);
+    }
+    buf[sizeof(buf)-1] = '\0';
+    out += buf;
+}
+
+void formatRecord(std::string& out, const traceRecord& R)
+{
+    size_t next = 0;
+    for(const char *f=R.fmt; *f; f++) {
+        if(*f!='%') {
+            out += *f;
+            continue;
+        }
+        if(f[1]=='%') {
+            out += '%';
+            f++;
+            continue;
+        }
+        size_t n = 1+strcspn(f+1, "diouxXcsfFeEgGp");
+        if(f[n]=='\0') { // truncated conversion
+            out += f;
+            break;
+        }
+        n++;
+        if(next<R.nargs)
+            formatArg(out, f, n, R.args[next++]);
+        else
+            out += "<?>";
+        f += n-1;
+    }
+}
+
+void traceGlobal::drain()
+{
+    Guard g(lock);
+
+    std::string msg;
+    for(size_t r=0; r<rings.size(); r++) {
+        traceRing& ring = *rings[r];
+
+        // read before head, so a released ring is seen with its last push()
+        const bool released = epicsAtomicGetIntT(&ring.released)!=0;
+        epicsAtomicReadMemoryBarrier();
+
+        size_t t = ring.tail,
+               h = epicsAtomicGetSizeT(&ring.head);
+        epicsAtomicReadMemoryBarrier();
+
+        for(; t!=h; t++) {
+            const traceRecord& R = ring.buf[t&(traceRing::size-1)];
+
+            char stamp[40];
+            epicsTime(R.stamp).strftime(stamp, sizeof(stamp), "%H:%M:%S.%06f");
+
+            msg = stamp;
+            msg += ' ';
+            msg += R.source;
+            msg += ": ";
+            formatRecord(msg, R);
+            msg += '\n';
+
+            errlogMessage(msg.c_str());
+        }
+
+        epicsAtomicSetSizeT(&ring.tail, t);
+
+        size_t lost = epicsAtomicGetSizeT(&ring.dropped);
+        if(lost) {
+            epicsAtomicSubSizeT(&ring.dropped, lost);
+            errlogPrintf("%s: %lu trace messages dropped\n",
+                         ring.thread.c_str(), (unsigned long)lost);
+        }
+
+        if(released) {
+            epicsAtomicSetIntT(&ring.released, 0);
+            unused.push_back(&ring);
+        }
+    }
+
+    size_t lost = epicsAtomicGetSizeT(&noring);
+    if(lost) {
+        epicsAtomicSubSizeT(&noring, lost);
+        errlogPrintf("%lu trace messages dropped, more than %u threads tracing\n",
+                     (unsigned long)lost, (unsigned)maxRings);
+    }
+}
+
+} // namespace
+
+void traceEmit(const char *source, const char *fmt, size_t nargs, const traceArg *args)
+{
+    epicsThreadOnce(&traceOnce, &traceInit, 0);
+    traceRing *R = traceState->ring();
+    if(R)
+        R->push(source, fmt, nargs, args);
+    else
+        epicsAtomicIncrSizeT(&traceState->noring);
+}
+
+void traceFlush()
+{
+    epicsThreadOnce(&traceOnce, &traceInit, 0);
+    traceState->drain();
+    errlogFlush();
+}
+
+} // namespace paramTable
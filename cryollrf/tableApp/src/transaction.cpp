@@ -0,0 +1,77 @@
+
+
+#include "paramtable/transaction.h"
+
+namespace paramTable {
+
+transaction::transaction(table& t)
+    :m_table(t)
+    ,m_staged(&m_own)
+    ,m_severity(NO_ALARM)
+    ,m_stamp()
+    ,m_stampSet(false)
+{
+    if(!t.m_staging)
+        t.m_staging = new detail::staging;
+    if(!t.m_staging->busy) {
+        // nested transactions on one table use their own storage
+        t.m_staging->busy = true;
+        m_staged = &t.m_staging->writes;
+    }
+}
+
+transaction::~transaction()
+{
+    abort();
+    if(m_staged!=&m_own)
+        m_table.m_staging->busy = false;
+}
+
+void transaction::check(valueBase& p)
+{
+    if(&p.getTable()!=&m_table)
+        throw std::logic_error("Parameter not in transaction table");
+    p.throwIfNotWritable();
+}
+
+void transaction::abort()
+{
+    // clear() keeps capacity for the next transaction
+    m_staged->clear();
+    m_stampSet = false;
+}
+
+void transaction::commit()
+{
+    if(m_staged->empty())
+        return;
+
+    epicsTime stamp(m_stampSet ? m_stamp : epicsTime::getCurrent());
+
+    bool changed = false;
+    try {
+        // apply everything before any listener runs
+        for(size_t i=0; i<m_staged->size(); i++) {
+            const detail::staged_write& S = (*m_staged)[i];
+            changed |= S.ops->apply(S.param, S.store, m_severity, stamp);
+        }
+    }catch(...){
+        abort();
+        throw;
+    }
+    abort();
+
+    if(!changed)
+        return;
+
+    // the changeset from this dispatch carries our time stamp.
+    // If already dispatching, these changes join the current changeset.
+    if(!m_table.m_active) {
+        m_table.m_changeset.timestamp = stamp;
+        m_table.m_changesetStampSet = true;
+    }
+
+    m_table.dispatch();
+}
+
+} // namespace paramTable
@@ -2,6 +2,7 @@
 #include <sstream>
 
 #include <alarm.h>
+#include <epicsTime.h>
 
 #include "paramtable/valueBase.h"
 #include "paramtable/group.h"
@@ -14,25 +15,37 @@ namespace paramTable {
 valueBase::valueBase(table& t, const std::string& n)
     :m_name(n)
     ,m_table(&t)
+    ,m_index(0)
     ,m_severity(INVALID_ALARM)
     ,m_stamp()
     ,m_active(false)
     ,m_changed(false)
     ,m_onchange(true)
     ,m_writeable(true)
+    ,m_restored(false)
+    ,m_nextChanged(0)
     ,m_baseListeners()
+    ,m_groups()
+    ,m_summaryOf()
+    ,m_throttle(0)
 {init();}
 
 valueBase::valueBase(group& g, const std::string& n)
     :m_name(n)
     ,m_table(&g.getTable())
+    ,m_index(0)
     ,m_severity(INVALID_ALARM)
     ,m_stamp()
     ,m_active(false)
     ,m_changed(false)
     ,m_onchange(true)
     ,m_writeable(true)
+    ,m_restored(false)
+    ,m_nextChanged(0)
     ,m_baseListeners()
+    ,m_groups()
+    ,m_summaryOf()
+    ,m_throttle(0)
 {init(); g<<*this;}
 
 void valueBase::init()
@@ -42,6 +55,16 @@ void valueBase::init()
 
 valueBase::~valueBase()
 {
+    while(!m_summaryOf.empty())
+        m_summaryOf.back()->publishSummary(0);
+    while(!m_groups.empty())
+        (*m_groups.back())>>(*this);
+    if(m_throttle && m_throttle->deferred) {
+        // the flush timer may be waiting for the lock
+        Guard g(m_table->mutex());
+        m_table->undefer(*this);
+    }
+    delete m_throttle;
 }
 
 std::string valueBase::fullName() const
@@ -67,7 +90,10 @@ void valueBase::setSeverity(short v)
 {
     if(v==m_severity)
         return;
+    short prev=m_severity;
     m_severity=v;
+    for(size_t i=0; i<m_groups.size(); i++)
+        m_groups[i]->severityChanged(prev, v);
     markChanged();
 }
 
@@ -101,6 +127,42 @@ void valueBase::markChanged()
     m_changed=true;
 }
 
+void valueBase::setMaxRate(double hz)
+{
+    if(hz<=0.0) {
+        if(m_throttle && m_throttle->deferred) {
+            // notify on the next dispatch()
+            m_table->undefer(*this);
+            m_table->markChanged(*this);
+        }
+        delete m_throttle;
+        m_throttle = 0;
+        return;
+    }
+    if(!m_throttle)
+        m_throttle = new detail::throttle;
+    m_throttle->interval = epicsUInt64(1e9/hz);
+}
+
+double valueBase::maxRate() const
+{
+    return m_throttle ? 1e9/double(m_throttle->interval) : 0.0;
+}
+
+bool valueBase::holdNotify()
+{
+    detail::throttle& T = *m_throttle;
+    epicsUInt64 now = epicsMonotonicGet();
+    if(now-T.last >= T.interval) {
+        T.last = now;
+        return false;
+    }
+    // remains m_changed, so later changes are coalesced
+    T.deferred = true;
+    m_table->defer(*this, T.last+T.interval, now);
+    return true;
+}
+
 void valueBase::dispatch()
 {
     try{
@@ -114,6 +176,11 @@ void valueBase::dispatch()
     m_changed = false;
 }
 
+void valueBase::subscriptions(std::vector<detail::subscription*>& out)
+{
+    m_baseListeners.subscriptions(out);
+}
+
 void valueBase::show(std::ostream& strm, int lvl) const
 {
     strm<<name();